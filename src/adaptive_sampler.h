@@ -0,0 +1,212 @@
+#ifndef _ADAPTIVE_SAMPLER_H_
+#define _ADAPTIVE_SAMPLER_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#include <chrono>
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Accumulates the samples of every pixel and decides where more samples are
+// needed. A pixel is converged once the standard error of its mean luminance
+// drops below the pixel noise target, and the whole frame is done once the
+// RMS error of all pixels meets the frame target, every pixel is converged or
+// the time is up.
+// ---------------------------------------------------------------------------
+*/
+class AdaptiveSampler
+{
+  /* AdaptiveSampler constructors */
+public:
+  AdaptiveSampler () = delete;
+  AdaptiveSampler
+  (
+   size_t   num_pixels,
+   uint32_t max_samples,
+   Float    pixel_noise_target,
+   Float    frame_noise_target,
+   double   time_budget
+  ) :
+    max_samples_        (max_samples),
+    pixel_noise_target_ (pixel_noise_target),
+    frame_noise_target_ (frame_noise_target),
+    time_budget_        (time_budget),
+    sum_          (num_pixels, Vec3 (0, 0, 0)),
+    sum_lum_      (num_pixels, 0.0),
+    sum_lum2_     (num_pixels, 0.0),
+    count_        (num_pixels, 0),
+    start_        (std::chrono::steady_clock::now ())
+  {}
+
+
+  /* AdaptiveSampler destructor */
+public:
+  virtual ~AdaptiveSampler () = default;
+
+
+  /* AdaptiveSampler public operators*/
+public:
+  AdaptiveSampler (const AdaptiveSampler&  sampler) = default;
+  AdaptiveSampler (      AdaptiveSampler&& sampler) = default;
+
+  auto operator = (const AdaptiveSampler&  sampler)
+    -> AdaptiveSampler& = default;
+  auto operator = (      AdaptiveSampler&& sampler)
+    -> AdaptiveSampler& = default;
+
+
+  /* AdaptiveSampler public methods */
+public:
+  // Forget every sample and restart the clock, the buffers are kept
+  auto Reset () -> void
+  {
+    std::fill (sum_.begin (),      sum_.end (),      Vec3 (0, 0, 0));
+    std::fill (sum_lum_.begin (),  sum_lum_.end (),  0.0);
+    std::fill (sum_lum2_.begin (), sum_lum2_.end (), 0.0);
+    std::fill (count_.begin (),    count_.end (),    0);
+    start_ = std::chrono::steady_clock::now ();
+  }
+
+  // Not synchronized, concurrent callers must feed disjoint pixels
+  auto AddSample (size_t pixel, const Vec3& radiance) -> void
+  {
+    const double lum (Luminance (radiance));
+    sum_[pixel]       = sum_[pixel] + radiance;
+    sum_lum_[pixel]  += lum;
+    sum_lum2_[pixel] += lum * lum;
+    ++count_[pixel];
+  }
+
+  // Relative standard error of the mean luminance of the pixel. Dark pixels
+  // are measured against a small floor, otherwise they never converge.
+  auto Error (size_t pixel) const -> Float
+  {
+    const uint32_t n (count_[pixel]);
+    if (n < 2)
+    {
+      return kFloatMax;
+    }
+    const double mean (sum_lum_[pixel] / n);
+    const double var  (std::max (0.0, sum_lum2_[pixel] / n - mean * mean)
+                       * n / (n - 1));
+    return std::sqrt (var / n) / (mean + 1e-2);
+  }
+
+  auto NeedsMoreSamples (size_t pixel) const -> bool
+  {
+    return count_[pixel] < max_samples_ && Error (pixel) > pixel_noise_target_;
+  }
+
+  auto PixelNoiseTarget () const -> Float
+  {
+    return pixel_noise_target_;
+  }
+
+  auto SetPixelNoiseTarget (Float target) -> void
+  {
+    pixel_noise_target_ = target;
+  }
+
+  auto SetTimeBudget (double seconds) -> void
+  {
+    time_budget_ = seconds;
+  }
+
+  // Whether a round of the given length still ends within the budget
+  auto HasTimeFor (double seconds) const -> bool
+  {
+    return ElapsedSeconds () + seconds <= time_budget_;
+  }
+
+  auto ElapsedSeconds () const -> double
+  {
+    const auto now (std::chrono::steady_clock::now ());
+    return std::chrono::duration <double> (now - start_).count ();
+  }
+
+  // Check the global stopping criteria
+  auto IsDone () const -> bool
+  {
+    if (ElapsedSeconds () >= time_budget_)
+    {
+      return true;
+    }
+
+    // Pixels without any sample are rendered somewhere else
+    size_t remaining (0);
+    size_t rendered  (0);
+    double error (0.0);
+    for (size_t i = 0; i < count_.size (); ++i)
+    {
+      if (count_[i] == 0)
+      {
+        continue;
+      }
+      ++rendered;
+      if (NeedsMoreSamples (i))
+      {
+        ++remaining;
+      }
+      const double e (std::min <double> (Error (i), 1.0));
+      error += e * e;
+    }
+    return remaining == 0
+        || std::sqrt (error / rendered) <= frame_noise_target_;
+  }
+
+  auto Color (size_t pixel) const -> Vec3
+  {
+    return count_[pixel] > 0
+         ? sum_[pixel] * (1.0 / static_cast <Float> (count_[pixel]))
+         : Vec3 (0, 0, 0);
+  }
+
+  auto AverageSamples () const -> double
+  {
+    double sum      (0.0);
+    size_t rendered (0);
+    for (const auto& n : count_)
+    {
+      sum += n;
+      rendered += n > 0 ? 1 : 0;
+    }
+    return rendered > 0 ? sum / rendered : 0.0;
+  }
+
+
+  /* AdaptiveSampler private methods */
+private:
+  static auto Luminance (const Vec3& v) -> double
+  {
+    return 0.2126 * v.r + 0.7152 * v.g + 0.0722 * v.b;
+  }
+
+
+  /* AdaptiveSampler private data */
+private:
+  uint32_t max_samples_;
+  Float    pixel_noise_target_;
+  Float    frame_noise_target_;
+  double   time_budget_;
+
+  std::vector <Vec3>     sum_;
+  std::vector <double>   sum_lum_;
+  std::vector <double>   sum_lum2_;
+  std::vector <uint32_t> count_;
+
+  std::chrono::steady_clock::time_point start_;
+}; // class AdaptiveSampler
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _ADAPTIVE_SAMPLER_H_
@@ -24,7 +24,7 @@ public:
 
   /* BoundingBox destructor */
 public:
-  virtual ~BoundingBox () = default;
+  ~BoundingBox () = default;
 
 
   /* BoundingBox public operators*/
@@ -59,6 +59,7 @@ public:
   Vec3 min;
   Vec3 max;
 }; // class BoundingBox
+ASSERT_RECORD_LAYOUT (BoundingBox, 2 * sizeof (Vec3), alignof (Float));
 /*
 // ---------------------------------------------------------------------------
 */
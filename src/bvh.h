@@ -0,0 +1,804 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#include "ray.h"
+#include "bounding_box.h"
+#include "surface_intersection_info.h"
+#include "thread_pool.h"
+#include "triangle_mesh.h"
+#include <algorithm>
+#include <numeric>
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+*/
+static const Float    kTriangleEpsilon = 1e-3; // Self intersection offset
+static const uint32_t kBvhStackSize    = 128;  // Traversal stack entries
+// Below kBvhMedianDepth nodes are split at the median, which halves them, so
+// 32 bit triangle counts are leaves well before kBvhMaxDepth. Interior nodes
+// stay above kBvhMaxDepth, where the traversal would overflow its stack.
+static const uint32_t kBvhMedianDepth  = kBvhStackSize - 40;
+static const uint32_t kBvhMaxDepth     = kBvhStackSize - 2;
+/*
+// ---------------------------------------------------------------------------
+// Node of the flattened tree. The two children of an interior node are
+// stored next to each other, so that one index is enough.
+// ---------------------------------------------------------------------------
+*/
+struct BvhNode
+{
+  Float    min[3];
+  uint32_t offset; // First child of an interior node, first triangle of a leaf
+  Float    max[3];
+  uint32_t count;  // Triangles of a leaf, 0 for an interior node
+}; // struct BvhNode
+ASSERT_RECORD_LAYOUT (BvhNode, 32, alignof (Float));
+/*
+// ---------------------------------------------------------------------------
+// Triangle as the Moller-Trumbore test reads it, one vertex and two edges.
+// Triangles are tested at Float precision, unlike the walls of the Cornell
+// box their coordinates are of the size of the scene.
+// ---------------------------------------------------------------------------
+*/
+struct BvhTriangle
+{
+  Vec3 v0;
+  Vec3 e1;
+  Vec3 e2;
+}; // struct BvhTriangle
+ASSERT_RECORD_LAYOUT (BvhTriangle, 3 * sizeof (Vec3), alignof (Float));
+/*
+// ---------------------------------------------------------------------------
+// Bounding volume hierarchy over boxes, split by the surface area heuristic
+// evaluated at kBvhBins positions per axis. It knows nothing about what the
+// boxes hold, the owner reorders its primitives in the order of the leaves
+// and tests them in the callbacks of Closest () and Any ().
+//
+// The build is parallel twice over. The top of the tree is split node by
+// node with every thread binning a slice of the triangles, and once the
+// nodes are small enough the subtrees are built each by one thread and
+// spliced into the node array.
+// ---------------------------------------------------------------------------
+*/
+class Bvh
+{
+  /* Bvh constructors */
+public:
+  Bvh () = default;
+
+
+  /* Bvh destructor */
+public:
+  ~Bvh () = default;
+
+
+  /* Bvh public operators*/
+public:
+  Bvh (const Bvh&  bvh) = default;
+  Bvh (      Bvh&& bvh) = default;
+
+  auto operator = (const Bvh&  bvh) -> Bvh& = default;
+  auto operator = (      Bvh&& bvh) -> Bvh& = default;
+
+
+  /* Bvh public methods */
+public:
+  auto NumNodes () const -> size_t
+  {
+    return nodes_.size ();
+  }
+
+  auto Bounds () const -> BoundingBox
+  {
+    BoundingBox bounds;
+    if (!nodes_.empty ())
+    {
+      bounds.Append (Vec3 (nodes_[0].min[0], nodes_[0].min[1], nodes_[0].min[2]));
+      bounds.Append (Vec3 (nodes_[0].max[0], nodes_[0].max[1], nodes_[0].max[2]));
+    }
+    return bounds;
+  }
+
+  // Build the tree
+  // Give:
+  //   - boxes, bounds of the primitives
+  //   - order, primitive of each leaf slot on return
+  auto Build
+  (
+   const std::vector <BoundingBox>& boxes,
+         ThreadPool*                pool,
+         std::vector <uint32_t>*    order
+  )
+    -> void
+  {
+    const uint32_t n (static_cast <uint32_t> (boxes.size ()));
+    nodes_.clear ();
+    order->clear ();
+    if (n == 0)
+    {
+      return;
+    }
+
+    // Centroids of the boxes
+    boxes_ = boxes.data ();
+    centroids_.resize (n);
+    order_.resize (n);
+    std::iota (order_.begin (), order_.end (), 0);
+    ForEachSlice (pool, 0, n, [&] (uint32_t begin, uint32_t end, size_t)
+    {
+      for (uint32_t i = begin; i < end; ++i)
+      {
+        centroids_[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+      }
+    });
+
+    // Top of the tree, one node at a time with parallel binning
+    const size_t   threads (pool != nullptr ? pool->NumThreads () : 1);
+    const uint32_t subtree_size
+      (std::max <uint32_t> (kBvhParallelSize,
+                            n / static_cast <uint32_t> (8 * threads)));
+    std::vector <Range> pending (1, Range {0, 0, n, 0});
+    std::vector <Range> subtrees;
+    nodes_.resize (1);
+    while (!pending.empty ())
+    {
+      const Range r (pending.back ());
+      pending.pop_back ();
+      if (r.end - r.begin <= subtree_size)
+      {
+        subtrees.push_back (r);
+        continue;
+      }
+      uint32_t mid;
+      if (!Split (pool, r, &nodes_[r.node], &mid))
+      {
+        continue;
+      }
+      const uint32_t left (static_cast <uint32_t> (nodes_.size ()));
+      nodes_[r.node].offset = left;
+      nodes_.resize (left + 2);
+      pending.push_back (Range {left,     r.begin, mid,   r.depth + 1});
+      pending.push_back (Range {left + 1, mid,     r.end, r.depth + 1});
+    }
+
+    // Subtrees, one thread each
+    std::vector <std::vector <BvhNode>> locals (subtrees.size ());
+    auto build_subtree = [&] (size_t i)
+    {
+      BuildSubtree (subtrees[i], &locals[i]);
+    };
+    if (pool != nullptr)
+    {
+      pool->ParallelFor (0, subtrees.size (), build_subtree);
+    }
+    else
+    {
+      for (size_t i = 0; i < subtrees.size (); ++i) { build_subtree (i); }
+    }
+
+    // Splice the subtrees, their roots take the place of the pending nodes
+    for (size_t i = 0; i < subtrees.size (); ++i)
+    {
+      const std::vector <BvhNode>& local (locals[i]);
+      const uint32_t shift (static_cast <uint32_t> (nodes_.size ()) - 1);
+      for (size_t k = 0; k < local.size (); ++k)
+      {
+        BvhNode node (local[k]);
+        if (node.count == 0)
+        {
+          node.offset += shift;
+        }
+        if (k == 0)
+        {
+          nodes_[subtrees[i].node] = node;
+        }
+        else
+        {
+          nodes_.push_back (node);
+        }
+      }
+    }
+
+    boxes_ = nullptr;
+    std::vector <Vec3> ().swap (centroids_);
+    order->swap (order_);
+    std::vector <uint32_t> ().swap (order_);
+  }
+
+  // Closest hit
+  // Give:
+  //   - t_max, distance of the closest hit so far, updated by test
+  //   - test (slot, &t_max), tests the primitive of a leaf slot and lowers
+  //     t_max on a nearer hit
+  template <typename F>
+  auto Closest (const Ray& ray, Float* t_max, F test) const -> void
+  {
+    if (nodes_.empty ())
+    {
+      return;
+    }
+
+    const Vec3 inv (InverseDirection (ray.direction));
+    uint32_t stack[kBvhStackSize];
+    uint32_t size (0);
+    stack[size++] = 0;
+    while (size > 0)
+    {
+      const BvhNode& node (nodes_[stack[--size]]);
+      if (node.count > 0)
+      {
+        for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+        {
+          test (i, t_max);
+        }
+        continue;
+      }
+
+      // Visit the nearer child first
+      const Float t0 (EntryDistance (nodes_[node.offset],     ray, inv, *t_max));
+      const Float t1 (EntryDistance (nodes_[node.offset + 1], ray, inv, *t_max));
+      const uint32_t near (t0 <= t1 ? node.offset : node.offset + 1);
+      const uint32_t far  (t0 <= t1 ? node.offset + 1 : node.offset);
+      if (std::max (t0, t1) < kFloatMax) { stack[size++] = far; }
+      if (std::min (t0, t1) < kFloatMax) { stack[size++] = near; }
+    }
+  }
+
+  // Any hit in (0, t_max), test (slot) answers for one primitive
+  template <typename F>
+  auto Any (const Ray& ray, Float t_max, F test) const -> bool
+  {
+    if (nodes_.empty ())
+    {
+      return false;
+    }
+
+    const Vec3 inv (InverseDirection (ray.direction));
+    uint32_t stack[kBvhStackSize];
+    uint32_t size (0);
+    stack[size++] = 0;
+    while (size > 0)
+    {
+      const BvhNode& node (nodes_[stack[--size]]);
+      if (EntryDistance (node, ray, inv, t_max) == kFloatMax)
+      {
+        continue;
+      }
+      if (node.count == 0)
+      {
+        stack[size++] = node.offset;
+        stack[size++] = node.offset + 1;
+        continue;
+      }
+      for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+      {
+        if (test (i))
+        {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+
+  /* Bvh private types */
+private:
+  struct Range
+  {
+    uint32_t node;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t depth; // Of the node, the root is at 0
+  }; // struct Range
+
+  struct Bin
+  {
+    BoundingBox bounds;
+    uint32_t    count;
+  }; // struct Bin
+
+  struct Bins
+  {
+    Bin bins[3][kBvhBins];
+  }; // struct Bins
+
+
+  /* Bvh private methods */
+private:
+  // Run f (begin, end, slice) over slices of [begin, end), in parallel when
+  // the range is large and a pool is given
+  template <typename F>
+  static auto ForEachSlice
+  (
+   ThreadPool* pool,
+   uint32_t    begin,
+   uint32_t    end,
+   F           f
+  )
+    -> void
+  {
+    if (NumSlices (pool, end - begin) == 1)
+    {
+      f (begin, end, 0);
+      return;
+    }
+    const uint32_t n      (end - begin);
+    const size_t   slices (pool->NumThreads ());
+    const uint32_t step   (static_cast <uint32_t> ((n + slices - 1) / slices));
+    pool->ParallelFor (0, slices, [&] (size_t s)
+    {
+      const uint32_t b (begin + static_cast <uint32_t> (s) * step);
+      const uint32_t e (std::min (end, b + step));
+      if (b < e)
+      {
+        f (b, e, s);
+      }
+    });
+  }
+
+  static auto NumSlices (ThreadPool* pool, uint32_t n) -> size_t
+  {
+    return pool == nullptr || n < kBvhParallelSize ? 1 : pool->NumThreads ();
+  }
+
+  static auto Merge (BoundingBox* a, const BoundingBox& b) -> void
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      a->min[i] = std::min (a->min[i], b.min[i]);
+      a->max[i] = std::max (a->max[i], b.max[i]);
+    }
+  }
+
+  static auto Grow (BoundingBox* a, const Vec3& v) -> void
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      a->min[i] = std::min (a->min[i], v[i]);
+      a->max[i] = std::max (a->max[i], v[i]);
+    }
+  }
+
+  static auto Area (const BoundingBox& b) -> Float
+  {
+    const Vec3 d (b.max - b.min);
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+  }
+
+  // Split a node by the binned SAH
+  // Return:
+  //   - false if the node stays a leaf
+  auto Split (ThreadPool* pool, const Range& r, BvhNode* node, uint32_t* mid)
+    -> bool
+  {
+    // Bounds of the node and of the centroids
+    const size_t slices (NumSlices (pool, r.end - r.begin));
+    std::vector <BoundingBox> node_bounds     (slices);
+    std::vector <BoundingBox> centroid_bounds (slices);
+    ForEachSlice (pool, r.begin, r.end, [&] (uint32_t b, uint32_t e, size_t s)
+    {
+      for (uint32_t i = b; i < e; ++i)
+      {
+        Merge (&node_bounds[s], boxes_[order_[i]]);
+        Grow (&centroid_bounds[s], centroids_[order_[i]]);
+      }
+    });
+    for (size_t s = 1; s < slices; ++s)
+    {
+      Merge (&node_bounds[0],     node_bounds[s]);
+      Merge (&centroid_bounds[0], centroid_bounds[s]);
+    }
+    const BoundingBox& bounds  (node_bounds[0]);
+    const BoundingBox& cbounds (centroid_bounds[0]);
+    for (int a = 0; a < 3; ++a)
+    {
+      node->min[a] = bounds.min[a];
+      node->max[a] = bounds.max[a];
+    }
+    node->offset = r.begin;
+    node->count  = r.end - r.begin;
+    if (node->count <= 2 || r.depth >= kBvhMaxDepth)
+    {
+      return false;
+    }
+    if (r.depth >= kBvhMedianDepth)
+    {
+      return SplitMedian (r, cbounds, node, mid);
+    }
+
+    // Bin the centroids
+    std::vector <Bins> slice_bins (slices);
+    for (auto& b : slice_bins)
+    {
+      for (auto& axis : b.bins) { for (auto& bin : axis) { bin.count = 0; } }
+    }
+    Vec3 scale;
+    for (int a = 0; a < 3; ++a)
+    {
+      const Float extent (cbounds.max[a] - cbounds.min[a]);
+      scale[a] = extent > 0.0f ? kBvhBins * (1.0f - 1e-5f) / extent : 0.0f;
+    }
+    ForEachSlice (pool, r.begin, r.end, [&] (uint32_t b, uint32_t e, size_t s)
+    {
+      Bins& bins (slice_bins[s]);
+      for (uint32_t i = b; i < e; ++i)
+      {
+        const uint32_t p (order_[i]);
+        for (int a = 0; a < 3; ++a)
+        {
+          const uint32_t k (BinIndex (centroids_[p][a], cbounds.min[a], scale[a]));
+          Merge (&bins.bins[a][k].bounds, boxes_[p]);
+          ++bins.bins[a][k].count;
+        }
+      }
+    });
+    Bins& bins (slice_bins[0]);
+    for (size_t s = 1; s < slices; ++s)
+    {
+      for (int a = 0; a < 3; ++a)
+      {
+        for (uint32_t k = 0; k < kBvhBins; ++k)
+        {
+          Merge (&bins.bins[a][k].bounds, slice_bins[s].bins[a][k].bounds);
+          bins.bins[a][k].count += slice_bins[s].bins[a][k].count;
+        }
+      }
+    }
+
+    // Sweep the split planes between the bins, the cost of a traversal step
+    // is taken as one triangle test
+    Float best_cost (kFloatMax);
+    int   best_axis (-1);
+    uint32_t best_bin (0);
+    for (int a = 0; a < 3; ++a)
+    {
+      if (scale[a] == 0.0f)
+      {
+        continue;
+      }
+      Float right_area[kBvhBins];
+      BoundingBox acc;
+      uint32_t    count (0);
+      for (uint32_t k = kBvhBins - 1; k > 0; --k)
+      {
+        Merge (&acc, bins.bins[a][k].bounds);
+        count += bins.bins[a][k].count;
+        right_area[k] = count > 0 ? Area (acc) * count : 0.0f;
+      }
+      acc   = BoundingBox ();
+      count = 0;
+      for (uint32_t k = 1; k < kBvhBins; ++k)
+      {
+        Merge (&acc, bins.bins[a][k - 1].bounds);
+        count += bins.bins[a][k - 1].count;
+        const Float cost ((count > 0 ? Area (acc) * count : 0.0f)
+                          + right_area[k]);
+        if (cost < best_cost)
+        {
+          best_cost = cost;
+          best_axis = a;
+          best_bin  = k;
+        }
+      }
+    }
+
+    const Float leaf_cost (Area (bounds) * node->count);
+    const Float split_cost (Area (bounds) + best_cost);
+    if (best_axis < 0
+        || (split_cost >= leaf_cost && node->count <= kBvhMaxLeafSize))
+    {
+      return false;
+    }
+
+    const int   a (best_axis);
+    const Float lo (cbounds.min[a]);
+    const Float s  (scale[a]);
+    uint32_t* split (std::partition (&order_[r.begin], &order_[0] + r.end,
+                                     [&] (uint32_t p)
+                                     {
+                                       return BinIndex (centroids_[p][a], lo, s)
+                                              < best_bin;
+                                     }));
+    *mid = static_cast <uint32_t> (split - &order_[0]);
+    if (*mid == r.begin || *mid == r.end)
+    {
+      return false;
+    }
+    node->offset = 0;
+    node->count  = 0;
+    return true;
+  }
+
+  // Split at the median centroid along the longest axis of the centroids,
+  // for the nodes too deep for the SAH
+  auto SplitMedian
+  (
+   const Range&       r,
+   const BoundingBox& cbounds,
+         BvhNode*     node,
+         uint32_t*    mid
+  )
+    -> bool
+  {
+    int a (0);
+    for (int i = 1; i < 3; ++i)
+    {
+      if (cbounds.max[i] - cbounds.min[i] > cbounds.max[a] - cbounds.min[a])
+      {
+        a = i;
+      }
+    }
+    *mid = r.begin + (r.end - r.begin) / 2;
+    std::nth_element (&order_[r.begin], &order_[*mid], &order_[0] + r.end,
+                      [&] (uint32_t p, uint32_t q)
+                      {
+                        return centroids_[p][a] < centroids_[q][a];
+                      });
+    node->offset = 0;
+    node->count  = 0;
+    return true;
+  }
+
+  static auto BinIndex (Float c, Float lo, Float scale) -> uint32_t
+  {
+    return std::min (static_cast <uint32_t> ((c - lo) * scale), kBvhBins - 1);
+  }
+
+  // Build the tree over the range on the calling thread, the root is
+  // nodes[0] and child indices are relative to nodes
+  auto BuildSubtree
+  (
+   const Range&           range,
+   std::vector <BvhNode>* nodes
+  )
+    -> void
+  {
+    std::vector <Range> pending (1, Range {0, range.begin, range.end,
+                                           range.depth});
+    nodes->resize (1);
+    while (!pending.empty ())
+    {
+      const Range r (pending.back ());
+      pending.pop_back ();
+      BvhNode  node;
+      uint32_t mid;
+      const bool is_split (Split (nullptr, r, &node, &mid));
+      if (is_split)
+      {
+        node.offset = static_cast <uint32_t> (nodes->size ());
+        pending.push_back (Range {node.offset,     r.begin, mid,
+                                  r.depth + 1});
+        pending.push_back (Range {node.offset + 1, mid,     r.end,
+                                  r.depth + 1});
+        nodes->resize (node.offset + 2);
+      }
+      (*nodes)[r.node] = node;
+    }
+  }
+
+  static auto InverseDirection (const Vec3& d) -> Vec3
+  {
+    // Avoid 0 * inf in the slab test
+    auto inv = [] (Float x)
+    {
+      return 1.0f / (std::abs (x) > 1e-20f ? x : 1e-20f);
+    };
+    return Vec3 (inv (d.x), inv (d.y), inv (d.z));
+  }
+
+  // Distance at which the ray enters the box, kFloatMax on a miss
+  static auto EntryDistance
+  (
+   const BvhNode& node,
+   const Ray&     ray,
+   const Vec3&    inv,
+         Float    t_max
+  )
+    -> Float
+  {
+    Float t_near (0.0f);
+    Float t_far  (t_max);
+    for (int a = 0; a < 3; ++a)
+    {
+      const Float t0 ((node.min[a] - ray.origin[a]) * inv[a]);
+      const Float t1 ((node.max[a] - ray.origin[a]) * inv[a]);
+      t_near = std::max (t_near, std::min (t0, t1));
+      t_far  = std::min (t_far,  std::max (t0, t1));
+    }
+    return t_near <= t_far ? t_near : kFloatMax;
+  }
+
+  /* Bvh private data */
+private:
+  std::vector <BvhNode> nodes_;
+
+  // Build state
+  const BoundingBox*     boxes_ = nullptr;
+  std::vector <Vec3>     centroids_;
+  std::vector <uint32_t> order_;
+}; // class Bvh
+/*
+// ---------------------------------------------------------------------------
+// Bvh over the triangles of one mesh, the triangles are copied in the order
+// of the leaves so that a leaf reads one contiguous run
+// ---------------------------------------------------------------------------
+*/
+class TriangleBvh
+{
+  /* TriangleBvh constructors */
+public:
+  TriangleBvh () = default;
+
+
+  /* TriangleBvh destructor */
+public:
+  ~TriangleBvh () = default;
+
+
+  /* TriangleBvh public operators*/
+public:
+  TriangleBvh (const TriangleBvh&  bvh) = default;
+  TriangleBvh (      TriangleBvh&& bvh) = default;
+
+  auto operator = (const TriangleBvh&  bvh) -> TriangleBvh& = default;
+  auto operator = (      TriangleBvh&& bvh) -> TriangleBvh& = default;
+
+
+  /* TriangleBvh public methods */
+public:
+  auto NumNodes () const -> size_t
+  {
+    return bvh_.NumNodes ();
+  }
+
+  auto NumTriangles () const -> size_t
+  {
+    return triangles_.size ();
+  }
+
+  auto Bounds () const -> BoundingBox
+  {
+    return bvh_.Bounds ();
+  }
+
+  auto MemoryBytes () const -> size_t
+  {
+    return NumNodes () * sizeof (BvhNode)
+         + NumTriangles () * sizeof (BvhTriangle);
+  }
+
+  // Build the tree, the mesh is not referred to afterwards
+  auto Build (const TriangleMesh& mesh, ThreadPool* pool) -> void
+  {
+    std::vector <BoundingBox> boxes (mesh.NumTriangles ());
+    for (size_t i = 0; i < boxes.size (); ++i)
+    {
+      Vec3 v0, v1, v2;
+      mesh.Triangle (i, &v0, &v1, &v2);
+      boxes[i].Append (v0);
+      boxes[i].Append (v1);
+      boxes[i].Append (v2);
+    }
+    std::vector <uint32_t> order;
+    bvh_.Build (boxes, pool, &order);
+
+    triangles_.resize (order.size ());
+    for (size_t i = 0; i < order.size (); ++i)
+    {
+      Vec3 v0, v1, v2;
+      mesh.Triangle (order[i], &v0, &v1, &v2);
+      triangles_[i] = BvhTriangle {v0, v1 - v0, v2 - v0};
+    }
+  }
+
+  // Closest triangle nearer than *t, the direction needs not be normalized
+  // Return:
+  //   - true on a hit, t and triangle are updated
+  auto Closest (const Ray& ray, Float* t, uint32_t* triangle) const -> bool
+  {
+    bool found (false);
+    bvh_.Closest (ray, t, [&] (uint32_t i, Float* t_max)
+    {
+      Float t_hit;
+      if (IntersectTriangle (triangles_[i], ray, *t_max, &t_hit))
+      {
+        *t_max    = t_hit;
+        *triangle = i;
+        found     = true;
+      }
+    });
+    return found;
+  }
+
+  // Geometric normal of a triangle, not oriented
+  auto Normal (uint32_t triangle) const -> Vec3
+  {
+    return Normalize (Cross (triangles_[triangle].e1, triangles_[triangle].e2));
+  }
+
+  // Closest hit nearer than info->t, info is filled on a hit
+  auto Intersect (const Ray& ray, SurfaceIntersectionInfo* info) const -> bool
+  {
+    Float    t (info->t);
+    uint32_t triangle;
+    if (!Closest (ray, &t, &triangle))
+    {
+      return false;
+    }
+    const Vec3 normal (Normal (triangle));
+    info->position        = ray.origin + ray.direction * t;
+    info->oriented_normal = Dot (normal, ray.direction) < 0.0
+                          ? normal : -1.0 * normal;
+    info->outgoing        = Normalize (-1.0 * ray.direction);
+    info->t               = t;
+    return true;
+  }
+
+  // Any hit in (0, t_max)
+  auto IsOccluded (const Ray& ray, Float t_max) const -> bool
+  {
+    return bvh_.Any (ray, t_max, [&] (uint32_t i)
+    {
+      Float t;
+      return IntersectTriangle (triangles_[i], ray, t_max, &t);
+    });
+  }
+
+
+  /* TriangleBvh private methods */
+private:
+  static auto IntersectTriangle
+  (
+   const BvhTriangle& tri,
+   const Ray&         ray,
+         Float        t_max,
+         Float*       t
+  )
+    -> bool
+  {
+    const Vec3  p   (Cross (ray.direction, tri.e2));
+    const Float det (Dot (tri.e1, p));
+    if (std::abs (det) < 1e-12f)
+    {
+      return false;
+    }
+    const Float inv_det (1.0f / det);
+    const Vec3  s (ray.origin - tri.v0);
+    const Float u (Dot (s, p) * inv_det);
+    if (u < 0.0f || u > 1.0f)
+    {
+      return false;
+    }
+    const Vec3  q (Cross (s, tri.e1));
+    const Float v (Dot (ray.direction, q) * inv_det);
+    if (v < 0.0f || u + v > 1.0f)
+    {
+      return false;
+    }
+    *t = Dot (tri.e2, q) * inv_det;
+    return *t > kTriangleEpsilon && *t < t_max;
+  }
+
+
+  /* TriangleBvh private data */
+private:
+  Bvh                       bvh_;
+  std::vector <BvhTriangle> triangles_;
+}; // class TriangleBvh
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _BVH_H_
@@ -35,7 +35,7 @@ public:
 
   /* Camera destructor */
 public:
-  virtual ~Camera () = default;
+  ~Camera () = default;
 
 
   /* Camera public operators*/
@@ -49,13 +49,23 @@ public:
 
   /* Camera public methods */
 public:
-  auto GenerateRay (uint32_t pixel_x, uint32_t pixel_y) -> Ray
+  auto GenerateRay (uint32_t pixel_x, uint32_t pixel_y) const -> Ray
+  {
+    return GenerateRay (pixel_x, pixel_y, 0.5, 0.5);
+  }
+
+  // Generate the ray through the sub-pixel position
+  // Give:
+  //   - pixel_x, pixel_y, pixel coordinates
+  //   - u, v, offset inside of the pixel in [0, 1)
+  auto GenerateRay (uint32_t pixel_x, uint32_t pixel_y, Float u, Float v)
+    const -> Ray
   {
     const Vec3 screen_position
       = screen_center_
-      + screen_x_ * ((static_cast <Float> (pixel_x + 0.5))
+      + screen_x_ * ((static_cast <Float> (pixel_x) + u)
                      / static_cast <Float> (kWidth)  - 0.5)
-      + screen_y_ * ((static_cast <Float> (pixel_y + 0.5))
+      + screen_y_ * ((static_cast <Float> (pixel_y) + v)
                      / static_cast <Float> (kHeight) - 0.5);
 
     const Vec3 dir = Normalize (screen_position - position_);
@@ -72,6 +82,7 @@ private:
   Vec3 screen_x_;
   Vec3 screen_y_;
 }; // class Camera
+ASSERT_RECORD_LAYOUT (Camera, 6 * sizeof (Vec3), alignof (Float));
 /*
 // ---------------------------------------------------------------------------
 */
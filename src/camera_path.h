@@ -0,0 +1,198 @@
+#ifndef _CAMERA_PATH_H_
+#define _CAMERA_PATH_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#include "camera.h"
+#include <fstream>
+#include <sstream>
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+*/
+struct CameraPose
+{
+  Vec3 position;
+  Vec3 target;
+  Vec3 up;
+}; // struct CameraPose
+/*
+// ---------------------------------------------------------------------------
+// Key poses of a camera animation. The poses are either rendered one by one
+// or sampled along a Catmull-Rom spline through them.
+// ---------------------------------------------------------------------------
+*/
+class CameraPath
+{
+  /* CameraPath constructors */
+public:
+  CameraPath () = default;
+
+
+  /* CameraPath destructor */
+public:
+  virtual ~CameraPath () = default;
+
+
+  /* CameraPath public operators*/
+public:
+  CameraPath (const CameraPath&  path) = default;
+  CameraPath (      CameraPath&& path) = default;
+
+  auto operator = (const CameraPath&  path) -> CameraPath& = default;
+  auto operator = (      CameraPath&& path) -> CameraPath& = default;
+
+
+  /* CameraPath public methods */
+public:
+  // Read the key poses from a text file, one pose per line
+  //   px py pz  tx ty tz  [ux uy uz]
+  // with the camera position, the point it looks at and the optional up
+  // vector. Empty lines and lines starting with '#' are skipped.
+  // Return:
+  //   - false if the file can not be read or has no pose
+  auto Load (const char* filename) -> bool
+  {
+    std::ifstream file (filename);
+    if (!file)
+    {
+      std::cerr << "Can not open camera path " << filename << std::endl;
+      return false;
+    }
+
+    keys_.clear ();
+    std::string line;
+    while (std::getline (file, line))
+    {
+      if (line.empty () || line[0] == '#')
+      {
+        continue;
+      }
+      std::istringstream ss (line);
+      CameraPose pose {Vec3 (), Vec3 (), Vec3 (0, 1, 0)};
+      if (!(ss >> pose.position.x >> pose.position.y >> pose.position.z
+               >> pose.target.x   >> pose.target.y   >> pose.target.z))
+      {
+        continue;
+      }
+      Vec3 up;
+      if (ss >> up.x >> up.y >> up.z)
+      {
+        pose.up = up;
+      }
+      keys_.push_back (pose);
+    }
+    return !keys_.empty ();
+  }
+
+  auto AddKey (const CameraPose& pose) -> void
+  {
+    keys_.push_back (pose);
+  }
+
+  auto NumKeys () const -> size_t
+  {
+    return keys_.size ();
+  }
+
+  // Pose on the spline at t in [0, 1], passing through every key
+  auto Sample (Float t) const -> CameraPose
+  {
+    if (keys_.size () == 1)
+    {
+      return keys_.front ();
+    }
+
+    const Float  s (std::min <Float> (std::max <Float> (t, 0.0), 1.0)
+                    * static_cast <Float> (keys_.size () - 1));
+    const size_t i (std::min <size_t> (static_cast <size_t> (s),
+                                       keys_.size () - 2));
+    const Float  f (s - static_cast <Float> (i));
+
+    // End points are repeated to close the first and the last segments
+    const CameraPose& p0 (keys_[i > 0 ? i - 1 : 0]);
+    const CameraPose& p1 (keys_[i]);
+    const CameraPose& p2 (keys_[i + 1]);
+    const CameraPose& p3 (keys_[std::min (i + 2, keys_.size () - 1)]);
+
+    return CameraPose {
+      CatmullRom (p0.position, p1.position, p2.position, p3.position, f),
+      CatmullRom (p0.target,   p1.target,   p2.target,   p3.target,   f),
+      CatmullRom (p0.up,       p1.up,       p2.up,       p3.up,       f)
+    };
+  }
+
+  static auto ToCamera (const CameraPose& pose) -> Camera
+  {
+    return Camera (pose.position,
+                   Normalize (pose.target - pose.position),
+                   Normalize (pose.up));
+  }
+
+  // Cameras of every frame
+  // Give:
+  //   - num_frames, number of frames sampled along the spline, or 0 to take
+  //     the key poses as they are
+  auto Cameras (size_t num_frames) const -> std::vector <Camera>
+  {
+    std::vector <Camera> cameras;
+    if (num_frames == 0)
+    {
+      for (const auto& key : keys_)
+      {
+        cameras.push_back (ToCamera (key));
+      }
+      return cameras;
+    }
+
+    for (size_t i = 0; i < num_frames; ++i)
+    {
+      const Float t (num_frames > 1
+                     ? static_cast <Float> (i) / (num_frames - 1)
+                     : 0.0);
+      cameras.push_back (ToCamera (Sample (t)));
+    }
+    return cameras;
+  }
+
+
+  /* CameraPath private methods */
+private:
+  static auto CatmullRom
+  (
+   const Vec3& p0,
+   const Vec3& p1,
+   const Vec3& p2,
+   const Vec3& p3,
+         Float t
+  )
+    -> Vec3
+  {
+    const Float t2 (t * t);
+    const Float t3 (t2 * t);
+    return 0.5 * ((2.0 * p1)
+                  + (p2 - p0) * t
+                  + (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * t2
+                  + (3.0 * p1 - p0 - 3.0 * p2 + p3) * t3);
+  }
+
+
+
+  /* CameraPath private data */
+private:
+  std::vector <CameraPose> keys_;
+}; // class CameraPath
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _CAMERA_PATH_H_
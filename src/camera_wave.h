@@ -0,0 +1,144 @@
+#ifndef _CAMERA_WAVE_H_
+#define _CAMERA_WAVE_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "ray.h"
+#include "vec3.h"
+#include "photon_map.h"
+#include <atomic>
+#include <chrono>
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Stages of the camera pass, in the order a tile goes through them
+// ---------------------------------------------------------------------------
+*/
+enum CameraStage
+{
+  kGenerateStage,  // Camera rays of the tile
+  kIntersectStage, // Closest matte hit, mirrors are followed
+  kSortStage,      // Hits ordered by surface and position
+  kGatherStage,    // Photon map irradiance estimates
+  kShadeStage,     // Emission, direct lighting and accumulation
+  kNumCameraStages
+}; // enum CameraStage
+
+static const char* const kCameraStageNames[kNumCameraStages] =
+{
+  "generate", "intersect", "sort", "gather", "shade"
+};
+/*
+// ---------------------------------------------------------------------------
+// First matte surface seen through a camera ray
+// ---------------------------------------------------------------------------
+*/
+struct CameraHit
+{
+  uint64_t key;      // Sort key, Morton code of the position in the tile
+  uint32_t pixel;
+  uint32_t surface;
+  Vec3     brdf;     // BRDF times the throughput of the specular bounces
+  Vec3     emission; // Emitted radiance times the same throughput
+  Vec3     position;
+  Vec3     normal;   // Oriented toward the camera ray
+}; // struct CameraHit
+ASSERT_RECORD_LAYOUT (CameraHit, 16 + 4 * sizeof (Vec3), alignof (uint64_t));
+/*
+// ---------------------------------------------------------------------------
+// Queues between the stages of one tile. They are cleared, never freed, so
+// that a tile keeps its capacity from round to round.
+// ---------------------------------------------------------------------------
+*/
+struct CameraQueues
+{
+  CameraQueues () : is_prepared (false) {}
+
+  auto Clear () -> void
+  {
+    rays.clear ();
+    ray_pixels.clear ();
+    misses.clear ();
+    hits.clear ();
+    queries.clear ();
+    is_prepared = false;
+  }
+
+  std::vector <Ray>         rays;
+  std::vector <uint32_t>    ray_pixels;
+  std::vector <uint32_t>    misses;     // Pixels whose ray left the scene
+  std::vector <CameraHit>   hits;
+  std::vector <GatherQuery> queries;    // In the order of the sorted hits
+  std::vector <Vec3>        irradiance; // One per query
+  bool                      is_prepared; // First round done up to sorting
+}; // struct CameraQueues
+/*
+// ---------------------------------------------------------------------------
+// Wall clock time spent in each stage, summed over the threads
+// ---------------------------------------------------------------------------
+*/
+class CameraStageTimes
+{
+  /* CameraStageTimes constructors */
+public:
+  CameraStageTimes ()
+  {
+    Reset ();
+  }
+
+
+  /* CameraStageTimes public methods */
+public:
+  auto Reset () -> void
+  {
+    for (auto& ns : ns_)
+    {
+      ns.store (0);
+    }
+  }
+
+  // Run f and charge its time to the stage
+  template <typename F>
+  auto Time (CameraStage stage, F f) -> void
+  {
+    const auto start (std::chrono::steady_clock::now ());
+    f ();
+    const auto end   (std::chrono::steady_clock::now ());
+    ns_[stage] += std::chrono::duration_cast <std::chrono::nanoseconds>
+                  (end - start).count ();
+  }
+
+  auto Seconds (CameraStage stage) const -> double
+  {
+    return ns_[stage].load () * 1e-9;
+  }
+
+  auto Print (std::ostream& os) const -> void
+  {
+    os << "camera stages (thread seconds):";
+    for (int s = 0; s < kNumCameraStages; ++s)
+    {
+      os << " " << kCameraStageNames[s] << " "
+         << Seconds (static_cast <CameraStage> (s));
+    }
+    os << std::endl;
+  }
+
+
+  /* CameraStageTimes private data */
+private:
+  std::atomic <uint64_t> ns_[kNumCameraStages];
+}; // class CameraStageTimes
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _CAMERA_WAVE_H_
@@ -3,11 +3,13 @@
 /*
 // ---------------------------------------------------------------------------
 */
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <limits>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 /*
 // ---------------------------------------------------------------------------
@@ -17,7 +19,11 @@ namespace
 /*
 // ---------------------------------------------------------------------------
 */
-typedef float Float;
+// Precision of each subsystem, fixed at compile time so that the hot loops
+// stay specialized
+typedef float  Float;          // Shading, photon storage and gathers
+typedef double IntersectFloat; // Ray-surface intersection, the walls are
+                               // spheres of radius 1e5
 /*
 // ---------------------------------------------------------------------------
 // Render settings
@@ -25,9 +31,111 @@ typedef float Float;
 */
 static const uint32_t kWidth       = 480;
 static const uint32_t kHeight      = 270;
-static const uint32_t kSuperSample = 2;
-static const uint32_t kSample      = 2;
-static const uint32_t kNumPhotons  = 1000000;
+static const uint32_t kSuperSample = 2;  // Strata per axis of the base pass
+static const uint32_t kSample      = 2;  // Samples per adaptive round
+static const uint32_t kNumPhotons  = 200000;
+static const uint32_t kProgressiveBatchSize = 20000; // Photons per batch
+static const size_t   kMaxFruitlessEmissions = 1 << 22; // Without a stored
+                                                       // photon, then give up
+static const uint32_t kTileRows    = 8;  // Rows per ray tracing task
+/*
+// ---------------------------------------------------------------------------
+// Gather settings
+// ---------------------------------------------------------------------------
+*/
+static const bool     kDirectLighting        = true;  // Shadow rays for lights
+static const uint32_t kGatherPhotons         = 50;
+static const float    kGatherMaxDistance     = 20.0;
+static const uint32_t kDensityGridResolution = 32;    // Cells per axis
+static const float    kGatherRadiusSlack     = 1.25;  // Initial radius margin
+static const uint32_t kGatherPacketSize      = 16;    // Queries per traversal
+/*
+// ---------------------------------------------------------------------------
+// Approximate gather settings. Aggregate gathers use a fixed radius from the
+// density grid, the k nearest photons are exact when their epsilon is 0.
+// ---------------------------------------------------------------------------
+*/
+static const bool     kAggregateGather     = false; // Subtree flux gathers
+static const float    kAggregateEpsilon    = 0.25;  // Subtree size / radius
+static const uint32_t kAggregateMinPhotons = 16;    // Smallest summarized
+static const float    kNearestEpsilon      = 0.0;   // Slack of the k nearest
+/*
+// ---------------------------------------------------------------------------
+// Photon map memory layout
+// ---------------------------------------------------------------------------
+*/
+static const bool     kBlockedPhotonLayout = true;
+static const int      kPhotonBlockDepth    = 4;     // Levels per block
+static const bool     kPhotonHugePages     = false; // Back photons by 2MB pages
+/*
+// ---------------------------------------------------------------------------
+// Photon map memory budget. With a budget the map holds as many photons as
+// the bytes allow and is reduced whenever it fills up, until kNumPhotons
+// photons have been stored in total.
+// ---------------------------------------------------------------------------
+*/
+static const size_t   kPhotonMemoryBudget = 0;    // Bytes, 0 for kNumPhotons
+static const bool     kMergePhotons       = true; // Merge, else thin
+static const float    kPhotonReduceRatio  = 0.5;  // Photons kept per reduction
+/*
+// ---------------------------------------------------------------------------
+// Wavefront photon tracing settings
+// ---------------------------------------------------------------------------
+*/
+static const bool     kWavefrontPhotons = true;
+static const uint32_t kWavefrontSize    = 16384; // Photons emitted per wave
+/*
+// ---------------------------------------------------------------------------
+// Scene settings
+// ---------------------------------------------------------------------------
+*/
+static const bool     kStaticScene = true; // Unrolled spheres, see StaticScene
+/*
+// ---------------------------------------------------------------------------
+// Triangle mesh BVH settings
+// ---------------------------------------------------------------------------
+*/
+static const uint32_t kBvhBins         = 16;    // SAH split candidates per axis
+static const uint32_t kBvhMaxLeafSize  = 8;     // Triangles per leaf at most
+static const uint32_t kBvhParallelSize = 65536; // Nodes binned by every thread
+/*
+// ---------------------------------------------------------------------------
+// Adaptive sampling settings
+// ---------------------------------------------------------------------------
+*/
+static const uint32_t kMaxSamplesPerPixel = 64;
+static const float    kPixelNoiseTarget   = 0.02;  // Relative standard error
+static const float    kFrameNoiseTarget   = 0.005; // RMS of the pixel errors
+static const double   kTimeBudget         = 60.0;  // Seconds for the camera pass
+/*
+// ---------------------------------------------------------------------------
+// Importance pre-pass settings
+// ---------------------------------------------------------------------------
+*/
+static const bool     kUseImportance           = true;
+static const uint32_t kImportanceResolution    = 32;  // Voxels per axis
+static const uint32_t kEmissionGuideThetaRes   = 16;
+static const uint32_t kEmissionGuidePhiRes     = 32;
+static const uint32_t kPilotPhotonsPerBin      = 64;
+static const float    kEmissionGuideUniform    = 0.1; // Uniformly emitted ratio
+/*
+// ---------------------------------------------------------------------------
+// Render server settings
+// ---------------------------------------------------------------------------
+*/
+static const uint32_t kServerCachedMaps = 4; // Balanced photon maps kept
+/*
+// ---------------------------------------------------------------------------
+// Deadline settings, see DeadlineController
+// ---------------------------------------------------------------------------
+*/
+static const uint32_t kDeadlinePilotPhotons = 20000;
+static const uint32_t kDeadlinePilotTiles   = 4;       // Tiles per pilot pass
+static const float    kDeadlinePhotonShare  = 0.25;    // Of the time left
+static const float    kDeadlineMargin       = 0.05;    // Kept for saving
+static const uint32_t kDeadlineMaxPhotons   = 4000000;
+static const uint32_t kDeadlineMinGather    = 16;
+static const uint32_t kDeadlineMaxGather    = 400;
 /*
 // ---------------------------------------------------------------------------
 // Global constant variables
@@ -39,10 +147,26 @@ static const Float kFloatMax = std::numeric_limits <Float>::max ();
 // static const Float kFloatMin = std::numeric_limits <Float>::min ();
 /*
 // ---------------------------------------------------------------------------
+// Records which are copied on the hot path or written to files must stay
+// plain data of a known size, so that they can be moved with memcpy
+// ---------------------------------------------------------------------------
+*/
+#define ASSERT_RECORD_LAYOUT(T, size, align)                                  \
+  static_assert (std::is_trivially_copyable <T>::value,                       \
+                 #T " must be trivially copyable");                           \
+  static_assert (std::is_standard_layout <T>::value,                          \
+                 #T " must be standard layout");                              \
+  static_assert (sizeof (T) == (size), #T " has an unexpected size");         \
+  static_assert (alignof (T) == (align), #T " has an unexpected alignment")
+/*
+// ---------------------------------------------------------------------------
 // Forward declarations
 // ---------------------------------------------------------------------------
 */
-class  Vec3;
+template <typename T>
+class  Vec3T;
+typedef Vec3T <Float>          Vec3;
+typedef Vec3T <IntersectFloat> IntersectVec3;
 struct Ray;
 class  Sphere;
 class  SurfaceIntersectionInfo;
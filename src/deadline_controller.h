@@ -0,0 +1,187 @@
+#ifndef _DEADLINE_CONTROLLER_H_
+#define _DEADLINE_CONTROLLER_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Settings chosen for a deadline
+// ---------------------------------------------------------------------------
+*/
+struct DeadlinePlan
+{
+  size_t   num_photons;
+  uint32_t gather_photons;
+  double   photon_seconds;  // Expected time of tracing and balancing
+  double   camera_seconds;  // Time left for the camera pass
+  double   samples;         // Expected samples per pixel
+}; // struct DeadlinePlan
+/*
+// ---------------------------------------------------------------------------
+// Splits a wall clock deadline between the photon count, the gather size and
+// the camera samples. Pilot runs measure the cost of a photon, traced and
+// balanced, and the cost of a camera sample as a linear function of the
+// gather size. Gathers also grow with the depth of the kd-tree, the log of
+// the photon count.
+// ---------------------------------------------------------------------------
+*/
+class DeadlineController
+{
+  /* DeadlineController constructors */
+public:
+  DeadlineController () = delete;
+  // Give:
+  //   - deadline, seconds from start
+  //   - start, usually the start of the process
+  DeadlineController
+  (
+   double                                deadline,
+   std::chrono::steady_clock::time_point start
+  ) :
+    deadline_       (deadline),
+    start_          (start),
+    photon_cost_    (0),
+    sample_base_    (0),
+    sample_gather_  (0),
+    pilot_photons_  (2)
+  {}
+
+
+  /* DeadlineController destructor */
+public:
+  virtual ~DeadlineController () = default;
+
+
+  /* DeadlineController public operators*/
+public:
+  DeadlineController (const DeadlineController&  c) = default;
+  DeadlineController (      DeadlineController&& c) = default;
+
+  auto operator = (const DeadlineController&  c) -> DeadlineController&
+    = default;
+  auto operator = (      DeadlineController&& c) -> DeadlineController&
+    = default;
+
+
+  /* DeadlineController public methods */
+public:
+  auto ElapsedSeconds () const -> double
+  {
+    return std::chrono::duration <double>
+           (std::chrono::steady_clock::now () - start_).count ();
+  }
+
+  // Time left before the deadline, less the margin for saving the image
+  auto RemainingSeconds () const -> double
+  {
+    return std::max (0.0, deadline_ * (1.0 - kDeadlineMargin)
+                          - ElapsedSeconds ());
+  }
+
+  // Give:
+  //   - num_photons, photons traced into the pilot map
+  //   - seconds, time of tracing and balancing them
+  auto MeasurePhotons (size_t num_photons, double seconds) -> void
+  {
+    pilot_photons_ = std::max <size_t> (num_photons, 2);
+    photon_cost_   = seconds / pilot_photons_;
+  }
+
+  // Two pilot camera passes with different gather sizes over the pilot map
+  // Give:
+  //   - k0, k1, gather sizes, k0 < k1
+  //   - seconds0, seconds1, wall clock time per sample of each pass
+  auto MeasureSamples (uint32_t k0, double seconds0,
+                       uint32_t k1, double seconds1) -> void
+  {
+    sample_gather_ = std::max (0.0, (seconds1 - seconds0) / (k1 - k0));
+    sample_base_   = std::max (0.0, seconds0 - sample_gather_ * k0);
+  }
+
+  // Wall clock time of one camera sample
+  auto SampleSeconds (uint32_t gather_photons, size_t num_photons) const
+    -> double
+  {
+    const double depth (std::log2 (std::max <double> (num_photons, 2))
+                        / std::log2 (static_cast <double> (pilot_photons_)));
+    return sample_base_ + sample_gather_ * gather_photons * depth;
+  }
+
+  // Photons take kDeadlinePhotonShare of the time left, the gather size
+  // follows the square root of the photon count so that the gather radius
+  // shrinks as the map gets denser. Photons are given back to the camera
+  // until the base pass fits into half of its time.
+  auto Plan () const -> DeadlinePlan
+  {
+    const double remaining (RemainingSeconds ());
+    const double pixels    (static_cast <double> (kWidth) * kHeight);
+    const double base      (kSuperSample * kSuperSample);
+
+    DeadlinePlan plan;
+    plan.num_photons = static_cast <size_t> (std::min <double>
+      (remaining * kDeadlinePhotonShare / std::max (photon_cost_, 1e-12),
+       kDeadlineMaxPhotons));
+    plan.num_photons = std::max <size_t> (plan.num_photons,
+                                          kDeadlinePilotPhotons);
+    while (true)
+    {
+      plan.gather_photons = static_cast <uint32_t> (std::min <double>
+        (std::max <double> (kGatherPhotons
+                            * std::sqrt (static_cast <double>
+                                         (plan.num_photons) / kNumPhotons),
+                            kDeadlineMinGather),
+         kDeadlineMaxGather));
+      plan.photon_seconds = plan.num_photons * photon_cost_;
+      plan.camera_seconds = std::max (0.0, remaining - plan.photon_seconds);
+      const double sample (SampleSeconds (plan.gather_photons,
+                                          plan.num_photons));
+      plan.samples = plan.camera_seconds / std::max (pixels * sample, 1e-12);
+      if (plan.samples >= 2 * base
+          || plan.num_photons / 2 < kDeadlinePilotPhotons)
+      {
+        return plan;
+      }
+      plan.num_photons /= 2;
+    }
+  }
+
+  auto Print (std::ostream& os, const DeadlinePlan& plan) const -> void
+  {
+    os << "Deadline " << deadline_ << " s: "
+       << 1.0 / std::max (photon_cost_, 1e-12) << " photons/s, "
+       << 1.0 / std::max (SampleSeconds (plan.gather_photons,
+                                         plan.num_photons), 1e-12)
+       << " samples/s. Chose " << plan.num_photons << " photons ("
+       << plan.photon_seconds << " s), gather " << plan.gather_photons
+       << ", " << plan.camera_seconds << " s for the camera, about "
+       << plan.samples << " samples per pixel." << std::endl;
+  }
+
+
+  /* DeadlineController private data */
+private:
+  double deadline_;
+  std::chrono::steady_clock::time_point start_;
+  double photon_cost_;    // Seconds per photon traced and balanced
+  double sample_base_;    // Seconds per camera sample without the gather
+  double sample_gather_;  // Seconds per gathered photon of a sample
+  size_t pilot_photons_;
+}; // class DeadlineController
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _DEADLINE_CONTROLLER_H_
@@ -0,0 +1,225 @@
+#ifndef _DYNAMIC_PHOTON_MAP_H_
+#define _DYNAMIC_PHOTON_MAP_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "photon_map.h"
+#include "scratch_arena.h"
+#include <atomic>
+#include <mutex>
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Photon map which keeps accepting photon batches while it is queried.
+//
+// Photons live in a forest of balanced kd-trees. A new batch becomes a tree
+// of its own and is merged with the trees less than twice its size, so
+// the tree sizes at least double from one to the next. Each photon is then
+// rebuilt O(log n) times in total, and a query visits O(log n) trees.
+//
+// Readers take a snapshot of the forest and never block. The writer builds
+// the new trees aside and publishes a new snapshot when they are ready.
+// Stored power is not scaled; queries divide by the number of photons
+// emitted so far.
+// ---------------------------------------------------------------------------
+*/
+class DynamicPhotonMap
+{
+  /* DynamicPhotonMap private types */
+private:
+  struct Forest
+  {
+    std::vector <std::shared_ptr <const PhotonMap>> trees; // Largest first
+    size_t num_emitted;
+    size_t num_photons;
+  }; // struct Forest
+
+
+  /* DynamicPhotonMap constructors */
+public:
+  DynamicPhotonMap () :
+    forest_ (std::make_shared <const Forest> (Forest {{}, 0, 0}))
+  {}
+
+
+  /* DynamicPhotonMap destructor */
+public:
+  virtual ~DynamicPhotonMap () = default;
+
+
+  /* DynamicPhotonMap public operators*/
+public:
+  DynamicPhotonMap (const DynamicPhotonMap&  map) = delete;
+  DynamicPhotonMap (      DynamicPhotonMap&& map) = delete;
+
+  auto operator = (const DynamicPhotonMap&  map) -> DynamicPhotonMap& = delete;
+  auto operator = (      DynamicPhotonMap&& map) -> DynamicPhotonMap& = delete;
+
+
+  /* DynamicPhotonMap public methods */
+public:
+  // Add the photons of an unbalanced map
+  // Give:
+  //   - batch, photons with unscaled power
+  //   - num_emitted, number of photons emitted to fill the batch
+  auto AddBatch (const PhotonMap& batch, size_t num_emitted) -> void
+  {
+    // Only one writer at a time, readers are not blocked
+    std::lock_guard <std::mutex> lock (writer_mutex_);
+    const std::shared_ptr <const Forest> current (Snapshot ());
+
+    // Merge the batch with the smallest trees until the next one is at least
+    // twice as large. Batches are not all the same size, so merging only
+    // trees which are not larger would let near equal trees pile up.
+    std::vector <std::shared_ptr <const PhotonMap>> trees (current->trees);
+    std::vector <const PhotonMap*> sources (1, &batch);
+    size_t size (batch.NumStoredPhotons ());
+    while (!trees.empty () && trees.back ()->NumStoredPhotons () < 2 * size)
+    {
+      size += trees.back ()->NumStoredPhotons ();
+      sources.push_back (trees.back ().get ());
+      trees.pop_back ();
+    }
+
+    if (size > 0)
+    {
+      std::shared_ptr <PhotonMap> tree (std::make_shared <PhotonMap> (size));
+      for (const auto& source : sources)
+      {
+        for (size_t i = 1; i <= source->NumStoredPhotons (); ++i)
+        {
+          tree->StorePhoton (source->StoredPhoton (i));
+        }
+      }
+      // The forest gathers through LocateNearest (), never the aggregates
+      tree->Balance (&arena_, false);
+      trees.push_back (tree);
+    }
+
+    // Publish the new forest
+    std::shared_ptr <const Forest> next
+      (std::make_shared <const Forest> (Forest {
+         trees,
+         current->num_emitted + num_emitted,
+         current->num_photons + batch.NumStoredPhotons ()}));
+    std::atomic_store (&forest_, next);
+  }
+
+  auto NumStoredPhotons () const -> size_t
+  {
+    return Snapshot ()->num_photons;
+  }
+
+  auto NumTrees () const -> size_t
+  {
+    return Snapshot ()->trees.size ();
+  }
+
+  // See PhotonMap::IrradianceEstimate ()
+  auto IrradianceEstimate
+  (
+   const Vec3&  position,
+   const Vec3&  normal,
+         Float  max_dist,
+         size_t num_photons
+  )
+    const -> Vec3
+  {
+    const std::shared_ptr <const Forest> forest (Snapshot ());
+    if (forest->trees.empty ())
+    {
+      return Vec3 (0, 0, 0);
+    }
+
+    // The candidates of all the trees share one heap
+    NearestPhotons np (position, max_dist, num_photons);
+    for (const auto& tree : forest->trees)
+    {
+      tree->LocateNearest (&np);
+    }
+    return forest->trees.front ()->IrradianceFromCandidates (&np, normal)
+         * (1.0 / static_cast <Float> (forest->num_emitted));
+  }
+
+  // See PhotonMap::IrradianceEstimateSorted ()
+  auto IrradianceEstimateSorted
+  (
+   const std::vector <GatherQuery>& queries,
+         Float                      max_dist,
+         size_t                     num_photons,
+         std::vector <Vec3>*        irradiance
+  )
+    const -> void
+  {
+    irradiance->assign (queries.size (), Vec3 (0, 0, 0));
+    const std::shared_ptr <const Forest> forest (Snapshot ());
+    if (forest->trees.empty ())
+    {
+      return ;
+    }
+
+    const Float scale (1.0 / static_cast <Float> (forest->num_emitted));
+    std::vector <NearestPhotons> packet;
+    packet.reserve (kGatherPacketSize);
+    NearestPhotons* nps[kGatherPacketSize];
+
+    for (size_t begin = 0; begin < queries.size (); begin += kGatherPacketSize)
+    {
+      const size_t end (std::min <size_t> (begin + kGatherPacketSize,
+                                           queries.size ()));
+      packet.clear ();
+      for (size_t i = begin; i < end; ++i)
+      {
+        packet.emplace_back (queries[i].position,
+                             max_dist,
+                             num_photons);
+      }
+      for (size_t i = 0; i < packet.size (); ++i)
+      {
+        nps[i] = &packet[i];
+      }
+
+      const uint32_t mask (packet.size () == 32
+                           ? 0xffffffff
+                           : (1u << packet.size ()) - 1);
+      for (const auto& tree : forest->trees)
+      {
+        tree->LocateNearestPacket (nps, mask);
+      }
+
+      for (size_t i = 0; i < packet.size (); ++i)
+      {
+        const size_t q (begin + i);
+        (*irradiance)[q] = forest->trees.front ()->IrradianceFromCandidates
+                             (&packet[i], queries[q].normal) * scale;
+      }
+    }
+  }
+
+
+  /* DynamicPhotonMap private methods */
+private:
+  auto Snapshot () const -> std::shared_ptr <const Forest>
+  {
+    return std::atomic_load (&forest_);
+  }
+
+
+  /* DynamicPhotonMap private data */
+private:
+  std::shared_ptr <const Forest> forest_;
+  std::mutex                     writer_mutex_;
+  ScratchArena                   arena_;
+}; // class DynamicPhotonMap
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _DYNAMIC_PHOTON_MAP_H_
@@ -0,0 +1,163 @@
+#ifndef _FAST_MATH_H_
+#define _FAST_MATH_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+/*
+// ---------------------------------------------------------------------------
+// Approximations for the direction sampling and encoding of photons. They are
+// written without branches so that the batched loops below vectorize.
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Sine and cosine of x, absolute error below 2e-7 on [-2pi, 2pi]. The angle
+// is reduced to [-pi/4, pi/4] around the nearest multiple of pi/2, the
+// remainder is evaluated by Taylor polynomials and the quadrant swaps and
+// negates the results. The reduction loses precision for large angles,
+// about 4e-6 at |x| = 100.
+// ---------------------------------------------------------------------------
+*/
+auto FastSinCos (Float x, Float* sin_x, Float* cos_x) -> void
+{
+  const Float kTwoOverPi = 0.636619772367581343;
+  const Float kPiOver2Hi = 1.57079637050628662;     // float (pi / 2)
+  const Float kPiOver2Lo = -4.37113900018624283e-8; // pi / 2 - kPiOver2Hi
+
+  const Float   q (std::floor (x * kTwoOverPi + 0.5f));
+  const int32_t k (static_cast <int32_t> (q));
+  const Float   r ((x - q * kPiOver2Hi) - q * kPiOver2Lo);
+  const Float   r2 (r * r);
+
+  const Float s (r + r * r2 * (-1.66666667e-1f + r2 * ( 8.33333333e-3f
+                + r2 * (-1.98412698e-4f + r2 *   2.75573192e-6f))));
+  const Float c (1.0f + r2 * (-0.5f + r2 * ( 4.16666667e-2f
+                + r2 * (-1.38888889e-3f + r2 *   2.48015873e-5f))));
+
+  const bool swap (k & 1);
+  const Float sign_s ((k & 2)       ? -1.0f : 1.0f);
+  const Float sign_c (((k + 1) & 2) ? -1.0f : 1.0f);
+  *sin_x = (swap ? c : s) * sign_s;
+  *cos_x = (swap ? s : c) * sign_c;
+}
+/*
+// ---------------------------------------------------------------------------
+// Octahedral direction encoding, two bytes per unit vector. The sphere is
+// projected on the octahedron |x| + |y| + |z| = 1, the lower half is folded
+// over the upper one and the square is quantized to 256 x 256 cells. The
+// error is below 1 degree, about the resolution of the old theta/phi tables,
+// without any transcendental in the encoder.
+// ---------------------------------------------------------------------------
+*/
+auto EncodeOctahedral
+(
+ Float          x,
+ Float          y,
+ Float          z,
+ unsigned char* u,
+ unsigned char* v
+)
+-> void
+{
+  const Float inv (1.0f / (std::abs (x) + std::abs (y) + std::abs (z)));
+  const Float px (x * inv);
+  const Float py (y * inv);
+  const Float fx ((1.0f - std::abs (py)) * (px >= 0.0f ? 1.0f : -1.0f));
+  const Float fy ((1.0f - std::abs (px)) * (py >= 0.0f ? 1.0f : -1.0f));
+  const Float ox (z >= 0.0f ? px : fx);
+  const Float oy (z >= 0.0f ? py : fy);
+  *u = static_cast <unsigned char> ((ox * 0.5f + 0.5f) * 255.0f + 0.5f);
+  *v = static_cast <unsigned char> ((oy * 0.5f + 0.5f) * 255.0f + 0.5f);
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+// Point on the octahedron, enough wherever only the sign of a dot product
+// matters
+auto DecodeOctahedralUnnormalized (unsigned char u, unsigned char v) -> Vec3
+{
+  const Float ox (u * (2.0f / 255.0f) - 1.0f);
+  const Float oy (v * (2.0f / 255.0f) - 1.0f);
+  const Float z  (1.0f - std::abs (ox) - std::abs (oy));
+  const Float t  (std::max (-z, 0.0f));
+  return Vec3 (ox - std::copysign (t, ox), oy - std::copysign (t, oy), z);
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto DecodeOctahedral (unsigned char u, unsigned char v) -> Vec3
+{
+  return Normalize (DecodeOctahedralUnnormalized (u, v));
+}
+/*
+// ---------------------------------------------------------------------------
+// Cosine weighted direction around +z
+// Give:
+//   - u1, u2, random numbers in [0, 1)
+// ---------------------------------------------------------------------------
+*/
+auto SampleCosineHemisphere (Float u1, Float u2) -> Vec3
+{
+  Float s, c;
+  FastSinCos (2.0f * kPi * u1, &s, &c);
+  const Float r (std::sqrt (u2));
+  return Vec3 (r * c, r * s, std::sqrt (1.0f - u2));
+}
+/*
+// ---------------------------------------------------------------------------
+// Batched versions over arrays of structures of arrays, one direction per
+// index. The loops carry no dependency and vectorize.
+// ---------------------------------------------------------------------------
+*/
+auto SampleCosineHemisphereBatch
+(
+ const Float* u1,
+ const Float* u2,
+       size_t count,
+       Float* x,
+       Float* y,
+       Float* z
+)
+-> void
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    Float s, c;
+    FastSinCos (2.0f * kPi * u1[i], &s, &c);
+    const Float r (std::sqrt (u2[i]));
+    x[i] = r * c;
+    y[i] = r * s;
+    z[i] = std::sqrt (1.0f - u2[i]);
+  }
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto EncodeOctahedralBatch
+(
+ const Float*         x,
+ const Float*         y,
+ const Float*         z,
+       size_t         count,
+       unsigned char* u,
+       unsigned char* v
+)
+-> void
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    EncodeOctahedral (x[i], y[i], z[i], &u[i], &v[i]);
+  }
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _FAST_MATH_H_
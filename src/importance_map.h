@@ -0,0 +1,256 @@
+#ifndef _IMPORTANCE_MAP_H_
+#define _IMPORTANCE_MAP_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#include "bounding_box.h"
+#include "fast_math.h"
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Coarse voxel grid of the importance deposited by importons traced from the
+// camera. A voxel with zero importance is never seen by the camera, so
+// photons landing there do not need to be stored.
+// ---------------------------------------------------------------------------
+*/
+class ImportanceMap
+{
+  /* ImportanceMap constructors */
+public:
+  ImportanceMap () = delete;
+  ImportanceMap (const BoundingBox& bounds, uint32_t resolution) :
+    bounds_     (bounds),
+    resolution_ (resolution),
+    importance_ (resolution * resolution * resolution, 0.0)
+  {
+    // Pad by one voxel so that hits on the boundary fall inside the grid
+    const Vec3 extent (bounds_.max - bounds_.min);
+    const Vec3 pad (extent * (1.0 / static_cast <Float> (resolution_)));
+    bounds_.min = bounds_.min - pad;
+    bounds_.max = bounds_.max + pad;
+
+    const Vec3 size (bounds_.max - bounds_.min);
+    for (int i = 0; i < 3; ++i)
+    {
+      inv_voxel_size_[i] = size[i] > 0.0
+                         ? static_cast <Float> (resolution_) / size[i]
+                         : 0.0;
+    }
+  }
+
+
+  /* ImportanceMap destructor */
+public:
+  virtual ~ImportanceMap () = default;
+
+
+  /* ImportanceMap public operators*/
+public:
+  ImportanceMap (const ImportanceMap&  map) = default;
+  ImportanceMap (      ImportanceMap&& map) = default;
+
+  auto operator = (const ImportanceMap&  map) -> ImportanceMap& = default;
+  auto operator = (      ImportanceMap&& map) -> ImportanceMap& = default;
+
+
+  /* ImportanceMap public methods */
+public:
+  // Deposit the importance of an importon hit
+  auto Deposit (const Vec3& position, Float importance) -> void
+  {
+    const int idx (VoxelIndex (position));
+    if (idx >= 0)
+    {
+      importance_[idx] += importance;
+    }
+  }
+
+  // Spread the importance to the 26 neighbours of every visible voxel, so
+  // that gathers near the edge of the visible region still find photons
+  auto Dilate () -> void
+  {
+    const int res (resolution_);
+    std::vector <Float> dilated (importance_);
+    for (int z = 0; z < res; ++z)
+    {
+      for (int y = 0; y < res; ++y)
+      {
+        for (int x = 0; x < res; ++x)
+        {
+          const Float v (importance_[(z * res + y) * res + x]);
+          if (v <= 0.0) { continue; }
+
+          for (int dz = std::max (z - 1, 0); dz <= std::min (z + 1, res - 1); ++dz)
+          for (int dy = std::max (y - 1, 0); dy <= std::min (y + 1, res - 1); ++dy)
+          for (int dx = std::max (x - 1, 0); dx <= std::min (x + 1, res - 1); ++dx)
+          {
+            Float& d (dilated[(dz * res + dy) * res + dx]);
+            d = std::max (d, v);
+          }
+        }
+      }
+    }
+    importance_.swap (dilated);
+  }
+
+  auto Importance (const Vec3& position) const -> Float
+  {
+    const int idx (VoxelIndex (position));
+    return idx >= 0 ? importance_[idx] : 0.0;
+  }
+
+  auto IsVisible (const Vec3& position) const -> bool
+  {
+    return Importance (position) > 0.0;
+  }
+
+
+  /* ImportanceMap private methods */
+private:
+  // Return -1 if the position is outside of the grid
+  auto VoxelIndex (const Vec3& position) const -> int
+  {
+    int v[3];
+    for (int i = 0; i < 3; ++i)
+    {
+      const Float f ((position[i] - bounds_.min[i]) * inv_voxel_size_[i]);
+      if (f < 0.0 || f >= static_cast <Float> (resolution_))
+      {
+        return -1;
+      }
+      v[i] = static_cast <int> (f);
+    }
+    return (v[2] * resolution_ + v[1]) * resolution_ + v[0];
+  }
+
+
+  /* ImportanceMap private data */
+private:
+  BoundingBox         bounds_;
+  uint32_t            resolution_;
+  Vec3                inv_voxel_size_;
+  std::vector <Float> importance_;
+}; // class ImportanceMap
+/*
+// ---------------------------------------------------------------------------
+// Piecewise constant distribution over the sphere of directions, used to
+// emit photons towards the directions which end up where the camera looks.
+// Bins are equal area, uniform in cos(theta) and phi.
+// ---------------------------------------------------------------------------
+*/
+class EmissionGuide
+{
+  /* EmissionGuide constructors */
+public:
+  EmissionGuide () = delete;
+  EmissionGuide (uint32_t theta_res, uint32_t phi_res) :
+    theta_res_ (theta_res),
+    phi_res_   (phi_res),
+    weight_    (theta_res * phi_res, 1.0),
+    cdf_       (theta_res * phi_res + 1, 0.0)
+  {
+    Build (1.0);
+  }
+
+
+  /* EmissionGuide destructor */
+public:
+  virtual ~EmissionGuide () = default;
+
+
+  /* EmissionGuide public operators*/
+public:
+  EmissionGuide (const EmissionGuide&  guide) = default;
+  EmissionGuide (      EmissionGuide&& guide) = default;
+
+  auto operator = (const EmissionGuide&  guide) -> EmissionGuide& = default;
+  auto operator = (      EmissionGuide&& guide) -> EmissionGuide& = default;
+
+
+  /* EmissionGuide public methods */
+public:
+  auto NumBins () const -> uint32_t
+  {
+    return theta_res_ * phi_res_;
+  }
+
+  // Set the unnormalized importance of the bin
+  auto SetWeight (uint32_t bin, Float weight) -> void
+  {
+    weight_[bin] = weight;
+  }
+
+  // Build the sampling distribution
+  // Give:
+  //   - uniform_ratio, fraction of photons emitted uniformly, which keeps
+  //     every direction reachable and the estimate unbiased
+  auto Build (Float uniform_ratio) -> void
+  {
+    Float sum (0.0);
+    for (const auto& w : weight_) { sum += w; }
+    if (sum <= 0.0) { uniform_ratio = 1.0; }
+
+    const Float inv_bins (1.0 / static_cast <Float> (NumBins ()));
+    for (uint32_t i = 0; i < NumBins (); ++i)
+    {
+      const Float guided (sum > 0.0 ? weight_[i] / sum : 0.0);
+      cdf_[i + 1] = cdf_[i]
+                  + uniform_ratio * inv_bins + (1.0 - uniform_ratio) * guided;
+    }
+    cdf_[NumBins ()] = 1.0;
+  }
+
+  // Sample a direction uniformly inside of the bin
+  auto SampleBin (uint32_t bin, Float u0, Float u1) const -> Vec3
+  {
+    const uint32_t it (bin / phi_res_);
+    const uint32_t ip (bin % phi_res_);
+    const Float cos_theta
+      (1.0 - 2.0 * (it + u0) / static_cast <Float> (theta_res_));
+    const Float sin_theta
+      (std::sqrt (std::max <Float> (0.0, 1.0 - cos_theta * cos_theta)));
+    const Float phi
+      (2.0 * kPi * (ip + u1) / static_cast <Float> (phi_res_));
+    Float sin_phi, cos_phi;
+    FastSinCos (phi, &sin_phi, &cos_phi);
+    return Vec3 (sin_theta * cos_phi,
+                 sin_theta * sin_phi,
+                 cos_theta);
+  }
+
+  // Sample a direction from the distribution
+  // Give:
+  //   - u0, u1, u2, random numbers in [0, 1)
+  //   - pdf, solid angle density of the sampled direction
+  auto Sample (Float u0, Float u1, Float u2, Float* pdf) const -> Vec3
+  {
+    const auto it (std::upper_bound (cdf_.begin () + 1, cdf_.end (), u0));
+    const uint32_t bin (std::min <uint32_t> (it - cdf_.begin () - 1,
+                                             NumBins () - 1));
+    *pdf = (cdf_[bin + 1] - cdf_[bin])
+         * static_cast <Float> (NumBins ()) / (4.0 * kPi);
+    return SampleBin (bin, u1, u2);
+  }
+
+
+  /* EmissionGuide private data */
+private:
+  uint32_t            theta_res_;
+  uint32_t            phi_res_;
+  std::vector <Float> weight_;
+  std::vector <Float> cdf_;
+}; // class EmissionGuide
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _IMPORTANCE_MAP_H_
@@ -0,0 +1,340 @@
+#ifndef _INSTANCE_H_
+#define _INSTANCE_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#include "ray.h"
+#include "bvh.h"
+#include "material.h"
+#include "bounding_box.h"
+#include "surface_intersection_info.h"
+#include "thread_pool.h"
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Affine transform, a 3 x 3 linear part and a translation, row major
+// ---------------------------------------------------------------------------
+*/
+class Transform
+{
+  /* Transform constructors */
+public:
+  Transform () :
+    m_ {1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, 0}
+  {}
+
+
+  /* Transform destructor */
+public:
+  ~Transform () = default;
+
+
+  /* Transform public operators*/
+public:
+  Transform (const Transform&  t) = default;
+  Transform (      Transform&& t) = default;
+
+  auto operator = (const Transform&  t) -> Transform& = default;
+  auto operator = (      Transform&& t) -> Transform& = default;
+
+  // Apply t first, then this
+  auto operator * (const Transform& t) const -> Transform
+  {
+    Transform r;
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 4; ++j)
+      {
+        r.m_[4 * i + j] = m_[4 * i] * t.m_[j]
+                        + m_[4 * i + 1] * t.m_[4 + j]
+                        + m_[4 * i + 2] * t.m_[8 + j]
+                        + (j == 3 ? m_[4 * i + 3] : 0.0f);
+      }
+    }
+    return r;
+  }
+
+
+  /* Transform public methods */
+public:
+  static auto Translate (const Vec3& v) -> Transform
+  {
+    Transform t;
+    t.m_[3] = v.x; t.m_[7] = v.y; t.m_[11] = v.z;
+    return t;
+  }
+
+  static auto Scale (Float s) -> Transform
+  {
+    Transform t;
+    t.m_[0] = s; t.m_[5] = s; t.m_[10] = s;
+    return t;
+  }
+
+  static auto RotateY (Float degrees) -> Transform
+  {
+    const Float a (degrees * kPi / 180.0f);
+    Transform t;
+    t.m_[0] =  std::cos (a); t.m_[2]  = std::sin (a);
+    t.m_[8] = -std::sin (a); t.m_[10] = std::cos (a);
+    return t;
+  }
+
+  auto Point (const Vec3& p) const -> Vec3
+  {
+    return Vector (p) + Vec3 (m_[3], m_[7], m_[11]);
+  }
+
+  auto Vector (const Vec3& v) const -> Vec3
+  {
+    return Vec3 (m_[0] * v.x + m_[1] * v.y + m_[2]  * v.z,
+                 m_[4] * v.x + m_[5] * v.y + m_[6]  * v.z,
+                 m_[8] * v.x + m_[9] * v.y + m_[10] * v.z);
+  }
+
+  // Linear part transposed. Normals go to world space through the
+  // transposed world to object transform.
+  auto TransposedVector (const Vec3& v) const -> Vec3
+  {
+    return Vec3 (m_[0] * v.x + m_[4] * v.y + m_[8]  * v.z,
+                 m_[1] * v.x + m_[5] * v.y + m_[9]  * v.z,
+                 m_[2] * v.x + m_[6] * v.y + m_[10] * v.z);
+  }
+
+  auto Inverse () const -> Transform
+  {
+    const Float a (m_[0]), b (m_[1]), c (m_[2]);
+    const Float d (m_[4]), e (m_[5]), f (m_[6]);
+    const Float g (m_[8]), h (m_[9]), k (m_[10]);
+    const Float det (a * (e * k - f * h) - b * (d * k - f * g)
+                     + c * (d * h - e * g));
+    const Float inv (1.0f / det);
+
+    Transform r;
+    r.m_[0] = (e * k - f * h) * inv;
+    r.m_[1] = (c * h - b * k) * inv;
+    r.m_[2] = (b * f - c * e) * inv;
+    r.m_[4] = (f * g - d * k) * inv;
+    r.m_[5] = (a * k - c * g) * inv;
+    r.m_[6] = (c * d - a * f) * inv;
+    r.m_[8] = (d * h - e * g) * inv;
+    r.m_[9] = (b * g - a * h) * inv;
+    r.m_[10] = (a * e - b * d) * inv;
+    const Vec3 t (r.Vector (Vec3 (m_[3], m_[7], m_[11])));
+    r.m_[3] = -t.x; r.m_[7] = -t.y; r.m_[11] = -t.z;
+    return r;
+  }
+
+
+  /* Transform private data */
+private:
+  Float m_[12];
+}; // class Transform
+ASSERT_RECORD_LAYOUT (Transform, 12 * sizeof (Float), alignof (Float));
+/*
+// ---------------------------------------------------------------------------
+// One placement of a mesh. Only the world to object transform is kept, rays
+// are moved into the space of the mesh and the normals moved back.
+// ---------------------------------------------------------------------------
+*/
+struct Instance
+{
+  Transform to_object;
+  uint32_t  mesh;
+  Material  material;
+}; // struct Instance
+ASSERT_RECORD_LAYOUT (Instance,
+                      sizeof (Transform) + 4 + sizeof (Material),
+                      alignof (Float));
+/*
+// ---------------------------------------------------------------------------
+// Two level acceleration structure. Every unique mesh has a TriangleBvh in
+// its own space (the bottom level), the top level is a Bvh over the world
+// bounds of the instances. Memory grows with the unique geometry, an
+// instance costs one Instance and its share of the top level nodes.
+// ---------------------------------------------------------------------------
+*/
+class InstancedScene
+{
+  /* InstancedScene constructors */
+public:
+  InstancedScene () = default;
+
+
+  /* InstancedScene destructor */
+public:
+  ~InstancedScene () = default;
+
+
+  /* InstancedScene public operators*/
+public:
+  InstancedScene (const InstancedScene&  scene) = delete;
+  InstancedScene (      InstancedScene&& scene) = default;
+
+  auto operator = (const InstancedScene&  scene) -> InstancedScene& = delete;
+  auto operator = (      InstancedScene&& scene) -> InstancedScene& = default;
+
+
+  /* InstancedScene public methods */
+public:
+  auto NumMeshes () const -> size_t
+  {
+    return meshes_.size ();
+  }
+
+  auto NumInstances () const -> size_t
+  {
+    return instances_.size ();
+  }
+
+  auto IsEmpty () const -> bool
+  {
+    return instances_.empty ();
+  }
+
+  // Bytes of the bottom level structures
+  auto MeshBytes () const -> size_t
+  {
+    size_t bytes (0);
+    for (const auto& mesh : meshes_)
+    {
+      bytes += mesh.MemoryBytes ();
+    }
+    return bytes;
+  }
+
+  // Bytes of the instances and of the top level structure
+  auto InstanceBytes () const -> size_t
+  {
+    return instances_.size () * sizeof (Instance)
+         + top_.NumNodes () * sizeof (BvhNode);
+  }
+
+  // Return:
+  //   - index of the mesh for AddInstance
+  auto AddMesh (TriangleBvh&& mesh) -> uint32_t
+  {
+    meshes_.push_back (std::move (mesh));
+    return static_cast <uint32_t> (meshes_.size () - 1);
+  }
+
+  auto AddInstance
+  (
+         uint32_t   mesh,
+   const Transform& to_world,
+   const Material&  material
+  )
+    -> void
+  {
+    instances_.push_back (Instance {to_world.Inverse (), mesh, material});
+
+    // World bounds from the corners of the object bounds
+    const BoundingBox b (meshes_[mesh].Bounds ());
+    BoundingBox world;
+    for (int i = 0; i < 8; ++i)
+    {
+      world.Append (to_world.Point (Vec3 (i & 1 ? b.max.x : b.min.x,
+                                          i & 2 ? b.max.y : b.min.y,
+                                          i & 4 ? b.max.z : b.min.z)));
+    }
+    bounds_.push_back (world);
+  }
+
+  // Build the top level once every instance is added. Instances are
+  // reordered, their indices are valid from here on.
+  auto Build (ThreadPool* pool) -> void
+  {
+    std::vector <uint32_t> order;
+    top_.Build (bounds_, pool, &order);
+
+    std::vector <Instance> instances;
+    instances.reserve (order.size ());
+    for (const auto i : order)
+    {
+      instances.push_back (instances_[i]);
+    }
+    instances_.swap (instances);
+    std::vector <BoundingBox> ().swap (bounds_);
+  }
+
+  auto GetMaterial (uint32_t instance) const -> const Material&
+  {
+    return instances_[instance].material;
+  }
+
+  // Closest hit nearer than info->t, info is filled on a hit
+  auto Intersect
+  (
+   const Ray&                     ray,
+         SurfaceIntersectionInfo* info,
+         uint32_t*                instance
+  )
+    const -> bool
+  {
+    Float    t (info->t);
+    uint32_t triangle (0);
+    bool     found (false);
+    top_.Closest (ray, &t, [&] (uint32_t i, Float* t_max)
+    {
+      // The direction is not normalized, t is the same in both spaces
+      const Instance& inst (instances_[i]);
+      const Ray local (inst.to_object.Point  (ray.origin),
+                       inst.to_object.Vector (ray.direction));
+      if (meshes_[inst.mesh].Closest (local, t_max, &triangle))
+      {
+        *instance = i;
+        found     = true;
+      }
+    });
+    if (!found)
+    {
+      return false;
+    }
+
+    const Instance& inst (instances_[*instance]);
+    const Vec3 normal (Normalize (inst.to_object.TransposedVector
+                                  (meshes_[inst.mesh].Normal (triangle))));
+    info->position        = ray.origin + ray.direction * t;
+    info->oriented_normal = Dot (normal, ray.direction) < 0.0
+                          ? normal : -1.0 * normal;
+    info->outgoing        = Normalize (-1.0 * ray.direction);
+    info->t               = t;
+    return true;
+  }
+
+  // Any hit in (0, t_max)
+  auto IsOccluded (const Ray& ray, Float t_max) const -> bool
+  {
+    return top_.Any (ray, t_max, [&] (uint32_t i)
+    {
+      const Instance& inst (instances_[i]);
+      const Ray local (inst.to_object.Point  (ray.origin),
+                       inst.to_object.Vector (ray.direction));
+      return meshes_[inst.mesh].IsOccluded (local, t_max);
+    });
+  }
+
+
+  /* InstancedScene private data */
+private:
+  std::vector <TriangleBvh> meshes_;
+  std::vector <Instance>    instances_;
+  std::vector <BoundingBox> bounds_; // World bounds until Build ()
+  Bvh                       top_;
+}; // class InstancedScene
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _INSTANCE_H_
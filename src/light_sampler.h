@@ -0,0 +1,246 @@
+#ifndef _LIGHT_SAMPLER_H_
+#define _LIGHT_SAMPLER_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#include "ray.h"
+#include "sphere.h"
+#include "point_light.h"
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Walker's alias method, a discrete distribution sampled in O (1) with one
+// random number. Built by Vose's algorithm in O (n).
+// ---------------------------------------------------------------------------
+*/
+class AliasTable
+{
+  /* AliasTable constructors */
+public:
+  AliasTable () = default;
+  explicit AliasTable (const std::vector <Float>& weights)
+  {
+    Build (weights);
+  }
+
+
+  /* AliasTable destructor */
+public:
+  ~AliasTable () = default;
+
+
+  /* AliasTable public operators*/
+public:
+  AliasTable (const AliasTable&  table) = default;
+  AliasTable (      AliasTable&& table) = default;
+
+  auto operator = (const AliasTable&  table) -> AliasTable& = default;
+  auto operator = (      AliasTable&& table) -> AliasTable& = default;
+
+
+  /* AliasTable public methods */
+public:
+  auto Size () const -> size_t
+  {
+    return pdf_.size ();
+  }
+
+  // Give:
+  //   - weights, unnormalized and not all zero
+  auto Build (const std::vector <Float>& weights) -> void
+  {
+    const size_t n (weights.size ());
+    pdf_.assign (n, 0.0);
+    threshold_.assign (n, 1.0);
+    alias_.resize (n);
+
+    double sum (0.0);
+    for (const auto w : weights) { sum += w; }
+
+    // Scaled so that the average is one, the small entries borrow from the
+    // large ones
+    std::vector <double>   scaled (n);
+    std::vector <uint32_t> small, large;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+      pdf_[i]   = static_cast <Float> (weights[i] / sum);
+      alias_[i] = i;
+      scaled[i] = weights[i] / sum * n;
+      (scaled[i] < 1.0 ? small : large).push_back (i);
+    }
+    while (!small.empty () && !large.empty ())
+    {
+      const uint32_t s (small.back ());
+      const uint32_t l (large.back ());
+      small.pop_back ();
+      threshold_[s] = static_cast <Float> (scaled[s]);
+      alias_[s]     = l;
+      scaled[l]    -= 1.0 - scaled[s];
+      if (scaled[l] < 1.0)
+      {
+        large.pop_back ();
+        small.push_back (l);
+      }
+    }
+    // What is left is one up to rounding
+  }
+
+  // Give:
+  //   - u, random number in [0, 1]
+  auto Sample (Float u) const -> uint32_t
+  {
+    const Float    x (u * static_cast <Float> (Size ()));
+    const uint32_t i (std::min (static_cast <uint32_t> (x),
+                                static_cast <uint32_t> (Size () - 1)));
+    return x - i < threshold_[i] ? i : alias_[i];
+  }
+
+  auto Probability (uint32_t i) const -> Float
+  {
+    return pdf_[i];
+  }
+
+
+  /* AliasTable private data */
+private:
+  std::vector <Float>    pdf_;
+  std::vector <Float>    threshold_;
+  std::vector <uint32_t> alias_;
+}; // class AliasTable
+/*
+// ---------------------------------------------------------------------------
+// Picks the light a photon is emitted from in proportion to the power of the
+// lights, the point lights and the emissive spheres together. The flux of the
+// photon is divided by the probability of its light, so the estimate stays
+// unbiased whatever the distribution.
+// ---------------------------------------------------------------------------
+*/
+class LightSampler
+{
+  /* LightSampler constructors */
+public:
+  LightSampler () = delete;
+  LightSampler
+  (
+   const std::vector <PointLight>& lights,
+   const std::vector <Sphere>&     spheres
+  ) :
+    lights_  (lights),
+    spheres_ (spheres)
+  {
+    std::vector <Float> power;
+    auto average = [] (const Vec3& v) { return (v.r + v.g + v.b) / 3.0f; };
+    for (uint32_t i = 0; i < lights.size (); ++i)
+    {
+      emitters_.push_back (Emitter {kPointEmitter, i});
+      power.push_back (average (lights[i].Power ()));
+    }
+    for (uint32_t i = 0; i < spheres.size (); ++i)
+    {
+      if (spheres[i].IsEmissive ())
+      {
+        emitters_.push_back (Emitter {kSphereEmitter, i});
+        power.push_back (average (spheres[i].Power ()));
+      }
+    }
+    table_.Build (power);
+  }
+
+
+  /* LightSampler destructor */
+public:
+  ~LightSampler () = default;
+
+
+  /* LightSampler public operators*/
+public:
+  LightSampler (const LightSampler&  sampler) = default;
+  LightSampler (      LightSampler&& sampler) = default;
+
+  auto operator = (const LightSampler&  sampler) -> LightSampler& = delete;
+  auto operator = (      LightSampler&& sampler) -> LightSampler& = delete;
+
+
+  /* LightSampler public methods */
+public:
+  auto NumEmitters () const -> size_t
+  {
+    return emitters_.size ();
+  }
+
+  // Emit one photon
+  // Give:
+  //   - guide, directions of the first point light, nullptr to emit
+  //     uniformly
+  //   - is_delta, set when the light is a point, whose direct lighting is
+  //     found by shadow rays
+  auto GeneratePhotonRay
+  (
+   const EmissionGuide* guide,
+         PhotonRay*     ray,
+         bool*          is_delta
+  )
+    const -> void
+  {
+    // A single light draws no random number, the photons stay the same
+    const uint32_t i (NumEmitters () > 1 ? table_.Sample (XorShift::Next01 ())
+                                         : 0);
+    const Emitter& e (emitters_[i]);
+    if (e.type == kPointEmitter)
+    {
+      const PointLight& light (lights_[e.index]);
+      if (guide != nullptr && e.index == 0)
+      {
+        light.GeneratePhotonRay (*guide, ray);
+      }
+      else
+      {
+        light.GeneratePhotonRay (ray);
+      }
+      *is_delta = true;
+    }
+    else
+    {
+      spheres_[e.index].GeneratePhotonRay (ray);
+      *is_delta = false;
+    }
+    ray->flux = ray->flux * (1.0 / table_.Probability (i));
+  }
+
+
+  /* LightSampler private types */
+private:
+  enum EmitterType
+  {
+    kPointEmitter,
+    kSphereEmitter
+  };
+
+  struct Emitter
+  {
+    EmitterType type;
+    uint32_t    index;
+  }; // struct Emitter
+
+
+  /* LightSampler private data */
+private:
+  const std::vector <PointLight>& lights_;
+  const std::vector <Sphere>&     spheres_;
+  std::vector <Emitter>           emitters_;
+  AliasTable                      table_;
+}; // class LightSampler
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _LIGHT_SAMPLER_H_
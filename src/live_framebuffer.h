@@ -0,0 +1,213 @@
+#ifndef _LIVE_FRAMEBUFFER_H_
+#define _LIVE_FRAMEBUFFER_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#include <atomic>
+#include <cstring>
+#include <string>
+#if defined (__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Layout of the shared memory segment
+//
+//   LiveFramebufferHeader
+//   uint64_t generation[num_tiles]
+//   float    pixels[height][width][3]
+//
+// Pixels are the mean linear radiance, the top row first like in the .ppm.
+// A generation is odd while its tile is written and even once the tile is
+// consistent, a viewer copies a tile and keeps the copy if the generation
+// is even and did not change meanwhile.
+// ---------------------------------------------------------------------------
+*/
+static const char kLiveFramebufferMagic[8] = {'P','M','L','I','V','E','0','1'};
+/*
+// ---------------------------------------------------------------------------
+*/
+enum LiveFramebufferFormat : uint32_t
+{
+  kLinearRgbFloat = 0
+}; // enum LiveFramebufferFormat
+/*
+// ---------------------------------------------------------------------------
+*/
+struct LiveFramebufferHeader
+{
+  char     magic[8];
+  uint32_t width;
+  uint32_t height;
+  uint32_t format;       // LiveFramebufferFormat
+  uint32_t tile_rows;    // Image rows per tile, the last tile may be shorter
+  uint32_t num_tiles;
+  uint32_t pixel_offset; // Bytes from the start of the segment to the pixels
+  uint64_t frame;        // Incremented when a new render starts
+}; // struct LiveFramebufferHeader
+ASSERT_RECORD_LAYOUT (LiveFramebufferHeader, 40, alignof (uint64_t));
+/*
+// ---------------------------------------------------------------------------
+// Writer side of a POSIX shared memory framebuffer. The render publishes
+// every tile after it is shaded, a viewer maps the same segment read only.
+// The segment outlives the renderer so that the last image stays visible,
+// it is replaced by the next Open () of the same name.
+// ---------------------------------------------------------------------------
+*/
+class LiveFramebuffer
+{
+  /* LiveFramebuffer constructors */
+public:
+  LiveFramebuffer () :
+    header_     (nullptr),
+    generation_ (nullptr),
+    pixels_     (nullptr),
+    bytes_      (0)
+  {}
+
+
+  /* LiveFramebuffer destructor */
+public:
+  virtual ~LiveFramebuffer ()
+  {
+#if defined (__unix__)
+    if (header_ != nullptr)
+    {
+      munmap (header_, bytes_);
+    }
+#endif
+  }
+
+
+  /* LiveFramebuffer public operators*/
+public:
+  LiveFramebuffer (const LiveFramebuffer&  fb) = delete;
+  LiveFramebuffer (      LiveFramebuffer&& fb) = delete;
+
+  auto operator = (const LiveFramebuffer&  fb) -> LiveFramebuffer& = delete;
+  auto operator = (      LiveFramebuffer&& fb) -> LiveFramebuffer& = delete;
+
+
+  /* LiveFramebuffer public methods */
+public:
+  // Create the segment, name is a shm_open () name such as "/photon-live"
+  auto Open (const std::string& name, uint32_t num_tiles) -> bool
+  {
+#if defined (__unix__)
+    static_assert (sizeof (std::atomic <uint64_t>) == sizeof (uint64_t),
+                   "Generations are plain 64 bit words in the segment");
+
+    const size_t pixel_offset (sizeof (LiveFramebufferHeader)
+                               + num_tiles * sizeof (uint64_t));
+    bytes_ = pixel_offset + size_t (kWidth) * kHeight * 3 * sizeof (float);
+
+    shm_unlink (name.c_str ());
+    const int fd (shm_open (name.c_str (), O_CREAT | O_EXCL | O_RDWR, 0644));
+    if (fd < 0)
+    {
+      std::cerr << "Can not create the shared memory " << name << std::endl;
+      return false;
+    }
+    void* ptr (MAP_FAILED);
+    if (ftruncate (fd, bytes_) == 0)
+    {
+      ptr = mmap (nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close (fd);
+    if (ptr == MAP_FAILED)
+    {
+      std::cerr << "Can not map the shared memory " << name << std::endl;
+      shm_unlink (name.c_str ());
+      return false;
+    }
+
+    // A fresh segment is zero filled, every generation starts even
+    header_     = static_cast <LiveFramebufferHeader*> (ptr);
+    generation_ = reinterpret_cast <std::atomic <uint64_t>*> (header_ + 1);
+    pixels_     = reinterpret_cast <float*>
+                  (static_cast <char*> (ptr) + pixel_offset);
+    header_->width        = kWidth;
+    header_->height       = kHeight;
+    header_->format       = kLinearRgbFloat;
+    header_->tile_rows    = kTileRows;
+    header_->num_tiles    = num_tiles;
+    header_->pixel_offset = static_cast <uint32_t> (pixel_offset);
+    header_->frame        = 0;
+    // The magic goes last, a viewer which sees it sees a complete header
+    std::atomic_thread_fence (std::memory_order_release);
+    std::memcpy (header_->magic, kLiveFramebufferMagic, 8);
+    std::cerr << "Live framebuffer " << name << ", "
+              << bytes_ / 1024 << " KB." << std::endl;
+    return true;
+#else
+    std::cerr << "Shared memory is not supported on this platform."
+              << std::endl;
+    return false;
+#endif
+  }
+
+  auto IsOpen () const -> bool
+  {
+    return header_ != nullptr;
+  }
+
+  auto BeginFrame () -> void
+  {
+    reinterpret_cast <std::atomic <uint64_t>*> (&header_->frame)
+      ->fetch_add (1, std::memory_order_release);
+  }
+
+  // Publish the pixels of a tile
+  // Give:
+  //   - tile, index of the band of kTileRows rows
+  //   - color, mean radiance of an image index, see SavePpm ()
+  template <typename ColorFunction>
+  auto WriteTile (uint32_t tile, ColorFunction color) -> void
+  {
+    std::atomic <uint64_t>& generation (generation_[tile]);
+    generation.fetch_add (1, std::memory_order_acq_rel);
+    std::atomic_thread_fence (std::memory_order_release);
+
+    const uint32_t y_begin (tile * kTileRows);
+    const uint32_t y_end   (std::min (y_begin + kTileRows, kHeight));
+    for (uint32_t y = y_begin; y < y_end; ++y)
+    {
+      const size_t row ((kHeight - 1 - y) * kWidth);
+      for (uint32_t x = 0; x < kWidth; ++x)
+      {
+        const Vec3 c (color (row + x));
+        float* const p (pixels_ + 3 * (row + x));
+        p[0] = c.r;
+        p[1] = c.g;
+        p[2] = c.b;
+      }
+    }
+
+    generation.fetch_add (1, std::memory_order_release);
+  }
+
+
+  /* LiveFramebuffer private data */
+private:
+  LiveFramebufferHeader*  header_;
+  std::atomic <uint64_t>* generation_;
+  float*                  pixels_;
+  size_t                  bytes_;
+}; // class LiveFramebuffer
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _LIVE_FRAMEBUFFER_H_
@@ -1,4 +1,5 @@
 #include "camera.h"
+#include "camera_path.h"
 #include "core.h"
 #include "vec3.h"
 #include "surface_intersection_info.h"
@@ -6,7 +7,38 @@
 #include "ray.h"
 #include "random.h"
 #include "point_light.h"
-#include "photonmap.h"
+#include "light_sampler.h"
+#include "photon_map.h"
+#include "dynamic_photon_map.h"
+#include "importance_map.h"
+#include "bounding_box.h"
+#include "morton.h"
+#include "adaptive_sampler.h"
+#include "thread_pool.h"
+#include "photon_chunk.h"
+#include "photon_wave.h"
+#include "camera_wave.h"
+#include "material.h"
+#include "triangle_mesh.h"
+#include "bvh.h"
+#include "instance.h"
+#include "render_server.h"
+#include "live_framebuffer.h"
+#include "deadline_controller.h"
+#include "static_scene.h"
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <chrono>
+#include "fast_math.h"
+#include <cstdio>
+#include <thread>
+#if defined (__unix__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -18,35 +50,69 @@ namespace
 /*
 // ---------------------------------------------------------------------------
 */
-const std::vector <Sphere> scene =
+// The Cornell box, fixed at compile time. Position, radius, emission,
+// reflectance, material type.
+constexpr StaticSphere kCornellBox[] =
 {
-  // Position, radius, emission, reflectance, material type
-  Sphere (Vec3 ( 1e5 + 1,         40.8, 81.6),         1e5,  Vec3 (),         Vec3 (0.75, 0.25, 0.25), kMatte), // left
-  Sphere (Vec3 (-1e5 + 99,        40.8, 81.6),         1e5,  Vec3 (),         Vec3 (0.25, 0.25, 0.75), kMatte), // right
-  Sphere (Vec3 (     50.0,        40.8, 1e5),          1e5,  Vec3 (),         Vec3 (0.75, 0.75, 0.75), kMatte), // back
-  Sphere (Vec3 (     50.0,        40.8, -1e5 + 250.0), 1e5,  Vec3 (),         Vec3 (),                 kMatte), // front
-  Sphere (Vec3 (     50.0,         1e5, 81.6),         1e5,  Vec3 (),         Vec3 (0.75, 0.75, 0.75), kMatte), // floor
-  Sphere (Vec3 (     50.0, -1e5 + 81.6, 81.6),         1e5,  Vec3 (),         Vec3 (0.75, 0.75, 0.75), kMatte), // ceiling
-  // Sphere (Vec3 (     65.0,        20.0, 20),           20,   Vec3 (),         Vec3 (0.25, 0.75, 0.25), kMatte), // green
-  // Sphere (Vec3 (     27.0,        16.5, 47),           16.5, Vec3 (),         Vec3 (0.99, 0.99, 0.99), kMatte), // mir
-  // Sphere (Vec3 (     77.0,        16.5, 78),           16.5, Vec3 (),         Vec3 (0.99, 0.99, 0.99), kMatte), //glass
-  // Sphere (Vec3 (     50.0,        90.0, 81.6),         15.0, Vec3 (36,36,36), Vec3 (),                 kMatte), // light
+  StaticSphere ( 1e5 + 1,         40.8, 81.6,         1e5,  0, 0, 0,    0.75, 0.25, 0.25, kMatte), // left
+  StaticSphere (-1e5 + 99,        40.8, 81.6,         1e5,  0, 0, 0,    0.25, 0.25, 0.75, kMatte), // right
+  StaticSphere (     50.0,        40.8, 1e5,          1e5,  0, 0, 0,    0.75, 0.75, 0.75, kMatte), // back
+  StaticSphere (     50.0,        40.8, -1e5 + 250.0, 1e5,  0, 0, 0,    0,    0,    0,    kMatte), // front
+  StaticSphere (     50.0,         1e5, 81.6,         1e5,  0, 0, 0,    0.75, 0.75, 0.75, kMatte), // floor
+  StaticSphere (     50.0, -1e5 + 81.6, 81.6,         1e5,  0, 0, 0,    0.75, 0.75, 0.75, kMatte), // ceiling
+  // StaticSphere (     65.0,        20.0, 20,           20,   0, 0, 0,    0.25, 0.75, 0.25, kMatte), // green
+  // StaticSphere (     27.0,        16.5, 47,           16.5, 0, 0, 0,    0.99, 0.99, 0.99, kMatte), // mir
+  // StaticSphere (     77.0,        16.5, 78,           16.5, 0, 0, 0,    0.99, 0.99, 0.99, kMatte), //glass
+  // StaticSphere (     50.0,        90.0, 81.6,         15.0, 36, 36, 36, 0,    0,    0,    kMatte), // light
 };
+struct CornellBox
+{
+  static constexpr size_t kSize = sizeof (kCornellBox) / sizeof (StaticSphere);
+  static constexpr auto At (size_t i) -> StaticSphere
+  {
+    return kCornellBox[i];
+  }
+}; // struct CornellBox
+typedef StaticScene <CornellBox> StaticCornellBox;
+// The same spheres for the runtime path, used when kStaticScene is off and by
+// the code which needs Sphere objects
+const std::vector <Sphere> scene (StaticCornellBox::MakeSpheres ());
+// Meshes are always matte, so without mirror spheres every material branch
+// on kMirror is compiled out
+constexpr bool kSceneHasMirrors = !kStaticScene
+                               || StaticCornellBox::Contains (kMirror);
 const std::vector <PointLight> lights =
 {
   // Position, power
-  PointLight (Vec3 (50, 60, 70.0), Vec3 (1,1,1))
+  PointLight (Vec3 (50, 60, 70.0), Vec3 (15000, 15000, 15000))
 };
-PhotonMap photon_map (kNumPhotons);
-Camera camera (Vec3 (50.0, 52.0, 220.0),
-               Normalize(Vec3 (0, -0.04, -1.0)),
-               Vec3 (0, 1, 0));
+const LightSampler light_sampler (lights, scene);
+// Photons a map for num_photons holds, photon 0 is the unused root of the
+// kd-tree
+auto PhotonMapCapacity (size_t num_photons) -> size_t
+{
+  return kPhotonMemoryBudget > 0 ? kPhotonMemoryBudget / sizeof (Photon) - 1
+                                 : num_photons;
+}
+PhotonMap photon_map (PhotonMapCapacity (kNumPhotons));
+std::unique_ptr <ImportanceMap> importance_map;
+EmissionGuide emission_guide (kEmissionGuideThetaRes, kEmissionGuidePhiRes);
+const Camera camera (Vec3 (50.0, 52.0, 220.0),
+                     Normalize(Vec3 (0, -0.04, -1.0)),
+                     Vec3 (0, 1, 0));
+
+// Triangle meshes given by --mesh and --instances, loaded before anything is
+// traced. The options are kept as given to pass them on to the workers.
+InstancedScene            meshes;
+std::vector <std::string> geometry_options;
 /*
 // ---------------------------------------------------------------------------
 // Save .ppm image
+// Return:
+//   - false if the file can not be written
 // ---------------------------------------------------------------------------
 */
-auto SavePpm (const char* filename, const Vec3* const image) -> void
+auto SavePpm (const char* filename, const Vec3* const image) -> bool
 {
   auto to_int = [] (Float val)
   {
@@ -56,6 +122,11 @@ auto SavePpm (const char* filename, const Vec3* const image) -> void
   };
 
   FILE* f = fopen (filename, "wb");
+  if (f == nullptr)
+  {
+    std::cerr << "Can not write " << filename << std::endl;
+    return false;
+  }
   fprintf(f, "P3\n%d %d\n%d\n", kWidth, kHeight, 255);
   for (int i = 0; i < kWidth * kHeight; i++)
   {
@@ -63,7 +134,7 @@ auto SavePpm (const char* filename, const Vec3* const image) -> void
                            to_int (image[i].g),
                            to_int (image[i].b));
   }
-  fclose(f);
+  return fclose(f) == 0;
 }
 /*
 // ---------------------------------------------------------------------------
@@ -74,15 +145,11 @@ auto ReflectAsMatte (const Vec3& normal) -> Vec3
   Vec3 tangent, binormal;
   BuildOrthoNormalBasis (normal, &tangent, &binormal);
 
-  const Float phi (XorShift::Next01 () * 2.0 * kPi);
-  const Float r2  (XorShift::Next01 ());
-  const Float r2s (std::sqrt (r2));
-
-  const Float tx (r2s * std::cos (phi));
-  const Float ty (r2s * std::sin (phi));
-  const Float tz (sqrt(1.0 - r2));
+  const Float u1 (XorShift::Next01 ());
+  const Float u2 (XorShift::Next01 ());
+  const Vec3  t (SampleCosineHemisphere (u1, u2));
 
-  return tz * normal + tx * tangent + ty * binormal;
+  return t.z * normal + t.x * tangent + t.y * binormal;
 }
 /*
 // ---------------------------------------------------------------------------
@@ -95,10 +162,28 @@ auto ReflectAsMirror (const Vec3& w, const Vec3& normal) -> Vec3
 /*
 // ---------------------------------------------------------------------------
 */
+// Surfaces are numbered the spheres first, then the mesh instances
+auto MaterialOf (int idx) -> Material
+{
+  const int num_spheres (static_cast <int> (scene.size ()));
+  if (idx >= num_spheres)
+  {
+    return meshes.GetMaterial (idx - num_spheres);
+  }
+  return kStaticScene ? StaticCornellBox::GetMaterial (idx)
+                      : scene[idx].GetMaterial ();
+}
+/*
+// ---------------------------------------------------------------------------
+*/
 auto IsIntersect (const Ray& ray, SurfaceIntersectionInfo* info) -> int
 {
   int intersect (-1);
-  for (int i = 0; i < scene.size (); ++i)
+  if (kStaticScene)
+  {
+    intersect = StaticCornellBox::Intersect (ray, info);
+  }
+  for (int i = 0; !kStaticScene && i < scene.size (); ++i)
   {
     SurfaceIntersectionInfo tmp;
     if (scene[i].IsIntersect(ray, &tmp))
@@ -110,139 +195,1886 @@ auto IsIntersect (const Ray& ray, SurfaceIntersectionInfo* info) -> int
       }
     }
   }
+
+  // The BVH only reports hits nearer than info->t
+  uint32_t instance;
+  if (meshes.Intersect (ray, info, &instance))
+  {
+    intersect = static_cast <int> (scene.size () + instance);
+  }
   return intersect;
 }
 /*
 // ---------------------------------------------------------------------------
 */
-auto EmitPhoton () -> void
+auto IsOccluded (const Ray& ray, Float max_t) -> bool
+{
+  // Any hit is enough, no need to find the closest one
+  if (kStaticScene && StaticCornellBox::IsOccluded (ray, max_t))
+  {
+    return true;
+  }
+  for (size_t i = 0; !kStaticScene && i < scene.size (); ++i)
+  {
+    if (scene[i].IsOccluded (ray, max_t))
+    {
+      return true;
+    }
+  }
+  return meshes.IsOccluded (ray, max_t);
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto EmitPhoton (PhotonMap* map) -> void
 {
-  // Generate photon ray to trace from point light
+  // Generate photon ray to trace from one of the lights. Photons coming
+  // straight from a point light are not stored when the direct lighting is
+  // computed by shadow rays.
   PhotonRay ray;
-  lights[0].GeneratePhotonRay (&ray);
-
+  bool      is_direct;
+  light_sampler.GeneratePhotonRay (kUseImportance ? &emission_guide : nullptr,
+                                   &ray, &is_direct);
   while (true)
   {
     // Intersection test
     int idx = 0;
     SurfaceIntersectionInfo info;
-    if ((idx = IsIntersect(ray, &info)) != -1)
-    {
-      const Sphere& s (scene[idx]);
-      if (s.type_ == MaterialType::kMatte)
-      {
-        // Photon ray was intersected with matte surface
-        // Store photon to photon map
-        // photon_map->StorePhotonRayAsPhoton (ray, info);
-        float power[3] = {ray.flux[0], ray.flux[1], ray.flux[2]};
-        float pos[3]   = {info.position[0], info.position[1], info.position[2]};
-        float dir[3]   = {info.outgoing[0], info.outgoing[1], info.outgoing[2]};
-        photon_map.store(power, pos, dir);
-
-        // Decide to continue more ray by russian roulette
-        const Float p (s.reflectance_.g);
-        if (XorShift::Next01 () < p)
-        {
-          // Continue to trace a photon
-          ray = PhotonRay (info.position,
-                           ReflectAsMatte(info.oriented_normal),
-                           ray.flux);
-          continue;
-        }
-        break;
-      }
+    if ((idx = IsIntersect(ray, &info)) == -1)
+    {
+      break;
+    }
+
+    const Material m (MaterialOf (idx));
+    if (kSceneHasMirrors && m.type == kMirror)
+    {
+      ray = PhotonRay (info.position,
+                       ReflectAsMirror (info.outgoing, info.oriented_normal),
+                       ray.flux);
+      is_direct = false;
+      continue;
+    }
+
+    // Photon ray was intersected with matte surface
+    // Store photon to photon map unless the camera never sees the surface
+    if ((!kDirectLighting || !is_direct) &&
+        (!importance_map || importance_map->IsVisible (info.position)))
+    {
+      map->StorePhotonRayAsPhoton (ray, info);
+    }
+    is_direct = false;
+
+    // Decide to continue more ray by russian roulette
+    const Float p (m.reflectance.g);
+    if (XorShift::Next01 () < p)
+    {
+      // Continue to trace a photon
+      ray = PhotonRay (info.position,
+                       ReflectAsMatte(info.oriented_normal),
+                       ray.flux);
+      continue;
     }
+    break;
   }
 }
 /*
 // ---------------------------------------------------------------------------
+// Wavefront photon tracing. A wave of photons is emitted together and the
+// rays in flight advance stage by stage: intersect, store, russian roulette
+// and bounce. Terminated rays are compacted away between the stages.
+// ---------------------------------------------------------------------------
 */
-auto PhotonTrace () -> void
+auto IntersectWave (PhotonWave* wave) -> void
 {
-  // Emit photons
-  for (int i = 0; i < kNumPhotons; ++i)
+  const size_t n (wave->Size ());
+  std::fill (wave->hit.begin (), wave->hit.end (), -1);
+  std::fill (wave->t.begin (), wave->t.end (),
+             std::numeric_limits <IntersectFloat>::max ());
+
+  // One sphere against all the rays, the inner loop has no branch
+  auto sweep = [wave, n] (int32_t s,
+                          IntersectFloat cx, IntersectFloat cy,
+                          IntersectFloat cz, IntersectFloat r2)
   {
-    EmitPhoton ();
-  } // End of for
+    for (size_t i = 0; i < n; ++i)
+    {
+      const IntersectFloat tx (cx - wave->ox[i]);
+      const IntersectFloat ty (cy - wave->oy[i]);
+      const IntersectFloat tz (cz - wave->oz[i]);
+      const IntersectFloat b  (tx * wave->dx[i]
+                             + ty * wave->dy[i]
+                             + tz * wave->dz[i]);
+      const IntersectFloat c  (b * b - (tx * tx + ty * ty + tz * tz) + r2);
+      const IntersectFloat sq (std::sqrt (std::max <IntersectFloat> (c, 0.0)));
+      const IntersectFloat t1 (b - sq);
+      const IntersectFloat t  (t1 > kSphereEpsilon ? t1 : b + sq);
+      const bool closer (c >= 0.0 && t > kSphereEpsilon && t < wave->t[i]);
+      wave->t[i]   = closer ? t : wave->t[i];
+      wave->hit[i] = closer ? s : wave->hit[i];
+    }
+  };
+  if (kStaticScene)
+  {
+    // The sphere constants are folded into each copy of the sweep
+    StaticCornellBox::ForEach ([&sweep] (auto index)
+    {
+      constexpr StaticSphere s (CornellBox::At (decltype (index)::value));
+      sweep (static_cast <int32_t> (index), s.center[0], s.center[1],
+             s.center[2], s.radius2);
+    });
+  }
+  for (size_t s = 0; !kStaticScene && s < scene.size (); ++s)
+  {
+    sweep (static_cast <int32_t> (s),
+           scene[s].center_.x, scene[s].center_.y, scene[s].center_.z,
+           static_cast <IntersectFloat> (scene[s].radius_) * scene[s].radius_);
+  }
+
+  // Hit positions and normals oriented toward the ray
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (wave->hit[i] < 0)
+    {
+      continue;
+    }
+    const IntersectFloat t (wave->t[i]);
+    const Vec3 p (static_cast <Float> (wave->ox[i] + wave->dx[i] * t),
+                  static_cast <Float> (wave->oy[i] + wave->dy[i] * t),
+                  static_cast <Float> (wave->oz[i] + wave->dz[i] * t));
+    const Vec3 normal (Normalize (p - scene[wave->hit[i]].center_));
+    const Vec3 oriented (Dot (normal, wave->Direction (i)) < 0.0
+                         ? normal : -1.0 * normal);
+    wave->px[i] = p.x;        wave->py[i] = p.y;        wave->pz[i] = p.z;
+    wave->nx[i] = oriented.x; wave->ny[i] = oriented.y; wave->nz[i] = oriented.z;
+  }
+
+  // Meshes, one BVH traversal per ray bounded by the closest sphere
+  for (size_t i = 0; !meshes.IsEmpty () && i < n; ++i)
+  {
+    SurfaceIntersectionInfo info;
+    info.t = static_cast <Float> (std::min <IntersectFloat> (wave->t[i],
+                                                             kFloatMax));
+    uint32_t instance;
+    if (!meshes.Intersect (Ray (wave->Origin (i), wave->Direction (i)),
+                           &info, &instance))
+    {
+      continue;
+    }
+    const Vec3& p (info.position);
+    const Vec3& o (info.oriented_normal);
+    wave->hit[i] = static_cast <int32_t> (scene.size () + instance);
+    wave->t[i]   = info.t;
+    wave->px[i] = p.x; wave->py[i] = p.y; wave->pz[i] = p.z;
+    wave->nx[i] = o.x; wave->ny[i] = o.y; wave->nz[i] = o.z;
+  }
 }
 /*
 // ---------------------------------------------------------------------------
+// Trace one wave to the end and collect the photons it stores
+// Give:
+//   - wave, the emitted rays, empty on return
+//   - photons, photons of the wave in the order they were stored
+//   - paths, index of the emitted photon of each stored photon
+// ---------------------------------------------------------------------------
 */
-auto Radiance (const Ray& ray, int depth) -> Vec3
+auto TraceWave
+(
+  PhotonWave*              wave,
+  std::vector <Photon>*    photons,
+  std::vector <uint32_t>*  paths
+)
+-> void
 {
-  SurfaceIntersectionInfo info;
-  int idx (IsIntersect (ray, &info));
+  std::vector <uint8_t>       keep;
+  std::vector <uint32_t>      store;
+  std::vector <Float>         x, y, z, u1, u2;
+  std::vector <unsigned char> du, dv, nu, nv;
 
-  if (idx == -1)
+  while (wave->Size () > 0)
   {
-    return Vec3 ();
+    // Intersect, the rays which miss leave the scene
+    IntersectWave (wave);
+    keep.resize (wave->Size ());
+    for (size_t i = 0; i < wave->Size (); ++i)
+    {
+      keep[i] = wave->hit[i] >= 0;
+    }
+    wave->Compact (keep);
+    const size_t n (wave->Size ());
+
+    // Store, photons land on the matte surfaces the camera may see
+    store.clear ();
+    for (size_t i = 0; i < n; ++i)
+    {
+      const bool is_matte (!kSceneHasMirrors
+                            || MaterialOf (wave->hit[i]).type == kMatte);
+      if (is_matte
+          && (!kDirectLighting || !wave->is_direct[i])
+          && (!importance_map || importance_map->IsVisible (wave->Position (i))))
+      {
+        store.push_back (static_cast <uint32_t> (i));
+      }
+    }
+    x.resize (store.size ()); y.resize (store.size ()); z.resize (store.size ());
+    du.resize (store.size ()); dv.resize (store.size ());
+    nu.resize (store.size ()); nv.resize (store.size ());
+    for (size_t k = 0; k < store.size (); ++k)
+    {
+      x[k] = wave->dx[store[k]];
+      y[k] = wave->dy[store[k]];
+      z[k] = wave->dz[store[k]];
+    }
+    EncodeOctahedralBatch (x.data (), y.data (), z.data (), store.size (),
+                           du.data (), dv.data ());
+    for (size_t k = 0; k < store.size (); ++k)
+    {
+      x[k] = wave->nx[store[k]];
+      y[k] = wave->ny[store[k]];
+      z[k] = wave->nz[store[k]];
+    }
+    EncodeOctahedralBatch (x.data (), y.data (), z.data (), store.size (),
+                           nu.data (), nv.data ());
+    for (size_t k = 0; k < store.size (); ++k)
+    {
+      const uint32_t i (store[k]);
+      photons->push_back (Photon (wave->Position (i), wave->Flux (i),
+                                  du[k], dv[k], nu[k], nv[k]));
+      paths->push_back (wave->path[i]);
+    }
+
+    // Russian roulette on the matte surfaces, mirrors always reflect
+    for (size_t i = 0; i < n; ++i)
+    {
+      const Material m (MaterialOf (wave->hit[i]));
+      keep[i] = (kSceneHasMirrors && m.type == kMirror)
+             || XorShift::Next01 () < m.reflectance.g;
+    }
+    keep.resize (n);
+    wave->Compact (keep);
+    const size_t m (wave->Size ());
+
+    // Bounce, cosine weighted directions are sampled for the whole wave
+    u1.resize (m); u2.resize (m);
+    x.resize (m);  y.resize (m);  z.resize (m);
+    for (size_t i = 0; i < m; ++i)
+    {
+      u1[i] = XorShift::Next01 ();
+      u2[i] = XorShift::Next01 ();
+    }
+    SampleCosineHemisphereBatch (u1.data (), u2.data (), m,
+                                 x.data (), y.data (), z.data ());
+    for (size_t i = 0; i < m; ++i)
+    {
+      const Vec3 normal (wave->Normal (i));
+      Vec3 d;
+      if (kSceneHasMirrors && MaterialOf (wave->hit[i]).type == kMirror)
+      {
+        d = ReflectAsMirror (-1.0 * wave->Direction (i), normal);
+      }
+      else
+      {
+        Vec3 tangent, binormal;
+        BuildOrthoNormalBasis (normal, &tangent, &binormal);
+        d = z[i] * normal + x[i] * tangent + y[i] * binormal;
+      }
+      wave->ox[i] = wave->px[i]; wave->oy[i] = wave->py[i]; wave->oz[i] = wave->pz[i];
+      wave->dx[i] = d.x;         wave->dy[i] = d.y;         wave->dz[i] = d.z;
+      wave->is_direct[i] = 0;
+    }
   }
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto WavefrontFillPhotonMap (PhotonMap* map) -> size_t
+{
+  PhotonWave             wave;
+  std::vector <Photon>   photons;
+  std::vector <uint32_t> paths;
+  std::vector <uint32_t> per_path (kWavefrontSize + 1);
 
-  // Get sphere
-  const Sphere* const s = &(scene.at (idx));
-  if (s->type_ == kMatte)
+  size_t num_emitted (0);
+  size_t num_fruitless (0); // Emitted in a row without storing a photon
+  while (!map->IsFull ())
   {
-    float estimated_irradiance[3];
-    float position[3] = {info.position.x, info.position.y, info.position.z};
-    float normal[3]   = {info.oriented_normal.x,
-                         info.oriented_normal.y,
-                         info.oriented_normal.z};
-    photon_map.irradiance_estimate (estimated_irradiance,
-                                    position,
-                                    normal,
-                                    20.0,
-                                    100);
-    const Vec3 brdf (s->reflectance_ * kInvPi);
-    return Vec3 (estimated_irradiance[0],
-                 estimated_irradiance[1],
-                 estimated_irradiance[2]) * brdf;
+    if (num_fruitless >= kMaxFruitlessEmissions)
+    {
+      std::cerr << "No photon stored in " << num_fruitless
+                << " emissions, the map is left partly filled." << std::endl;
+      break;
+    }
+
+    // Emit
+    wave.Resize (kWavefrontSize);
+    for (uint32_t i = 0; i < kWavefrontSize; ++i)
+    {
+      PhotonRay ray;
+      bool      is_delta;
+      light_sampler.GeneratePhotonRay (kUseImportance ? &emission_guide
+                                                      : nullptr,
+                                       &ray, &is_delta);
+      wave.Set (i, ray, i);
+      wave.is_direct[i] = is_delta;
+    }
+
+    photons.clear ();
+    paths.clear ();
+    TraceWave (&wave, &photons, &paths);
+
+    const size_t room (map->Capacity () - map->NumStoredPhotons ());
+    if (photons.size () <= room)
+    {
+      map->StorePhotons (photons.data (), photons.size ());
+      num_emitted  += kWavefrontSize;
+      num_fruitless = photons.empty () ? num_fruitless + kWavefrontSize : 0;
+      continue;
+    }
+
+    // The last wave does not fit. Keep the first paths whose photons all fit
+    // and count only them as emitted, a path is never cut in the middle.
+    std::fill (per_path.begin (), per_path.end (), 0);
+    for (const auto p : paths) { ++per_path[p]; }
+    uint32_t cut (0);
+    for (size_t sum (0); cut < kWavefrontSize; ++cut)
+    {
+      if (sum + per_path[cut] > room) { break; }
+      sum += per_path[cut];
+    }
+    size_t kept (0);
+    for (size_t i = 0; i < photons.size (); ++i)
+    {
+      if (paths[i] < cut) { photons[kept++] = photons[i]; }
+    }
+    map->StorePhotons (photons.data (), kept);
+    num_emitted += cut;
+    break;
   }
+  return num_emitted;
 }
 /*
 // ---------------------------------------------------------------------------
+// Emit photons until the map is filled up
+// Return:
+//   - number of emitted photons
+// ---------------------------------------------------------------------------
 */
-auto RayTrace () -> void
+auto FillPhotonMap (PhotonMap* map) -> size_t
 {
-  // Image buffer
-  std::unique_ptr <Vec3 []> img (new Vec3 [kWidth * kHeight]);
+  if (kWavefrontPhotons)
+  {
+    return WavefrontFillPhotonMap (map);
+  }
 
-  for (int y = 0; y < kHeight; ++y)
+  size_t num_emitted (0);
+  size_t num_fruitless (0); // Emitted in a row without storing a photon
+  for (; !map->IsFull (); ++num_emitted)
   {
-    for (int x = 0; x < kWidth; ++x)
+    if (num_fruitless >= kMaxFruitlessEmissions)
     {
-      const uint32_t idx ((kHeight - 1 - y) * (kWidth)  + x);
-      Ray ray (camera.GenerateRay (x, y));
+      std::cerr << "No photon stored in " << num_fruitless
+                << " emissions, the map is left partly filled." << std::endl;
+      break;
+    }
+    const size_t num_stored (map->NumStoredPhotons ());
+    EmitPhoton (map);
+    num_fruitless = map->NumStoredPhotons () == num_stored
+                  ? num_fruitless + 1 : 0;
+  } // End of for
+  return num_emitted;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto PhotonTrace (PhotonMap* map, size_t num_photons) -> void
+{
+  // Emit photons until the photon map is filled up. Within a memory budget
+  // the map is reduced and filled again until num_photons photons are in.
+  size_t num_emitted (FillPhotonMap (map));
+  size_t num_traced  (map->NumStoredPhotons ());
+  while (kPhotonMemoryBudget > 0 && num_traced < num_photons)
+  {
+    const size_t num_full (map->NumStoredPhotons ());
+    map->Reduce (static_cast <size_t> (map->Capacity ()
+                                       * kPhotonReduceRatio),
+                 kMergePhotons);
+    const size_t num_kept (map->NumStoredPhotons ());
+    if (num_kept >= num_full)
+    {
+      std::cerr << "The photon map can not be reduced further." << std::endl;
+      break;
+    }
+    num_emitted += FillPhotonMap (map);
+    num_traced  += map->NumStoredPhotons () - num_kept;
+    if (map->NumStoredPhotons () == num_kept)
+    {
+      // The fill gave up, see kMaxFruitlessEmissions
+      break;
+    }
+  }
+  map->ScalePhotonPower (1.0 / static_cast <Float> (num_emitted));
+  std::cerr << num_emitted << " photons emitted." << std::endl;
+  if (kPhotonMemoryBudget > 0)
+  {
+    std::cerr << num_traced << " photons stored as "
+              << map->NumStoredPhotons () << " within "
+              << kPhotonMemoryBudget / 1024 << " KB." << std::endl;
+  }
+}
+/*
+// ---------------------------------------------------------------------------
+// Importance pre-pass
+// ---------------------------------------------------------------------------
+*/
+auto TraceImporton (Ray ray, std::vector <Vec3>* hits) -> void
+{
+  // Follow specular bounces until the importon lands on a matte surface
+  for (int depth = 0; depth < 8; ++depth)
+  {
+    SurfaceIntersectionInfo info;
+    const int idx (IsIntersect (ray, &info));
+    if (idx == -1)
+    {
+      return ;
+    }
+    if (!kSceneHasMirrors || MaterialOf (idx).type == kMatte)
+    {
+      hits->push_back (info.position);
+      return ;
+    }
+    ray = Ray (info.position,
+               ReflectAsMirror (info.outgoing, info.oriented_normal));
+  }
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto TracePilotPhoton (PhotonRay ray) -> Float
+{
+  // Sum up the importance of every surface the photon path is stored on
+  Float importance (0.0);
+  bool is_direct (true);
+  for (int depth = 0; depth < 8; ++depth)
+  {
+    SurfaceIntersectionInfo info;
+    const int idx (IsIntersect (ray, &info));
+    if (idx == -1)
+    {
+      break;
+    }
+
+    const Material m (MaterialOf (idx));
+    if (kSceneHasMirrors && m.type == kMirror)
+    {
+      ray = PhotonRay (info.position,
+                       ReflectAsMirror (info.outgoing, info.oriented_normal),
+                       ray.flux);
+      is_direct = false;
+      continue;
+    }
+
+    if (!kDirectLighting || !is_direct)
+    {
+      importance += importance_map->Importance (info.position);
+    }
+    is_direct = false;
+    if (XorShift::Next01 () >= m.reflectance.g)
+    {
+      break;
+    }
+    ray = PhotonRay (info.position,
+                     ReflectAsMatte (info.oriented_normal),
+                     ray.flux);
+  }
+  return importance;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto ImportonTrace (const std::vector <Camera>& cameras) -> void
+{
+  // Trace importons from every camera and record where they land. The pixel
+  // grid is thinned with the number of cameras so that a long path costs
+  // about as much as a single frame, dilation fills the gaps.
+  const uint32_t stride (static_cast <uint32_t>
+                         (std::ceil (std::sqrt (cameras.size ()))));
+  std::vector <Vec3> hits;
+  hits.reserve (kWidth * kHeight);
+  for (const auto& cam : cameras)
+  {
+    for (uint32_t y = 0; y < kHeight; y += stride)
+    {
+      for (uint32_t x = 0; x < kWidth; x += stride)
+      {
+        TraceImporton (cam.GenerateRay (x, y), &hits);
+      }
+    }
+  }
 
-      auto tmp = Radiance (ray, 0);
-      img [idx] = tmp;
+  // A camera which sees none of the scene gives no importance at all, the
+  // culling would reject every photon. Photons are then emitted uniformly and
+  // stored everywhere.
+  if (hits.empty ())
+  {
+    std::cerr << "No importon landed, photons are not culled." << std::endl;
+    importance_map.reset ();
+    for (uint32_t bin = 0; bin < emission_guide.NumBins (); ++bin)
+    {
+      emission_guide.SetWeight (bin, 1.0);
+    }
+    emission_guide.Build (1.0);
+    return ;
+  }
+
+  // Build the importance map over the visible region
+  BoundingBox bounds;
+  for (const auto& h : hits) { bounds.Append (h); }
+  importance_map.reset (new ImportanceMap (bounds, kImportanceResolution));
+  for (const auto& h : hits)
+  {
+    importance_map->Deposit (h, 1.0);
+  }
+  importance_map->Dilate ();
+
+  // Estimate the importance reached from each emission direction
+  for (uint32_t bin = 0; bin < emission_guide.NumBins (); ++bin)
+  {
+    Float importance (0.0);
+    for (uint32_t i = 0; i < kPilotPhotonsPerBin; ++i)
+    {
+      const Vec3 dir (emission_guide.SampleBin (bin,
+                                                XorShift::Next01 (),
+                                                XorShift::Next01 ()));
+      importance += TracePilotPhoton (PhotonRay (lights[0].Position (),
+                                                 dir,
+                                                 Vec3 (1, 1, 1)));
     }
+    emission_guide.SetWeight (bin, importance / kPilotPhotonsPerBin);
   }
+  emission_guide.Build (kEmissionGuideUniform);
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto DirectIrradiance (const Vec3& position, const Vec3& normal) -> Vec3
+{
+  // Sum up the lights visible from the position
+  Vec3 irradiance (0, 0, 0);
+  for (const auto& light : lights)
+  {
+    Vec3  incident;
+    Float distance;
+    const Vec3 e (light.Illuminate (position, &incident, &distance));
 
-  SavePpm("output.ppm", img.get ());
+    const Float cos_term (Dot (incident, normal));
+    if (cos_term <= 0.0)
+    {
+      continue;
+    }
+    if (IsOccluded (Ray (position, incident), distance))
+    {
+      continue;
+    }
+    irradiance = irradiance + e * cos_term;
+  }
+  return irradiance;
 }
 /*
 // ---------------------------------------------------------------------------
+// Camera pass stages. Every tile pushes its rays through the stages one
+// after the other, each stage sweeps the queue left by the previous one.
+// ---------------------------------------------------------------------------
 */
-auto Render () -> void
+auto GenerateStage
+(
+  const Camera&          camera,
+        uint32_t         tile,
+        uint32_t         round,
+  const AdaptiveSampler& sampler,
+        CameraQueues*    queues
+)
+-> void
 {
+  const Float inv_strata (1.0 / static_cast <Float> (kSuperSample));
+  auto push = [queues] (uint32_t idx, const Ray& ray)
+  {
+    queues->rays.push_back (ray);
+    queues->ray_pixels.push_back (idx);
+  };
 
+  const uint32_t y_begin (tile * kTileRows);
+  const uint32_t y_end   (std::min (y_begin + kTileRows, kHeight));
+  for (uint32_t y = y_begin; y < y_end; ++y)
+  {
+    for (uint32_t x = 0; x < kWidth; ++x)
+    {
+      const uint32_t idx ((kHeight - 1 - y) * (kWidth)  + x);
+      if (round == 0)
+      {
+        // Base pass, stratified over kSuperSample x kSuperSample sub-pixels
+        for (uint32_t sy = 0; sy < kSuperSample; ++sy)
+        {
+          for (uint32_t sx = 0; sx < kSuperSample; ++sx)
+          {
+            const Float u ((sx + XorShift::Next01 ()) * inv_strata);
+            const Float v ((sy + XorShift::Next01 ()) * inv_strata);
+            push (idx, camera.GenerateRay (x, y, u, v));
+          }
+        }
+      }
+      else if (sampler.NeedsMoreSamples (idx))
+      {
+        for (uint32_t i = 0; i < kSample; ++i)
+        {
+          push (idx, camera.GenerateRay (x, y,
+                                         XorShift::Next01 (),
+                                         XorShift::Next01 ()));
+        }
+      }
+    }
+  }
 }
 /*
 // ---------------------------------------------------------------------------
+// Follow the camera rays to the first matte surface. Rays which leave the
+// scene are queued as misses, they add a black sample when shading.
+// ---------------------------------------------------------------------------
 */
-}  // namespace
+auto IntersectStage (CameraQueues* queues) -> void
+{
+  for (size_t i = 0; i < queues->rays.size (); ++i)
+  {
+    Ray  ray (queues->rays[i]);
+    Vec3 throughput (1, 1, 1);
+    bool found (false);
+    for (int depth = 0; depth < 8 && !found; ++depth)
+    {
+      SurfaceIntersectionInfo info;
+      const int idx (IsIntersect (ray, &info));
+      if (idx == -1)
+      {
+        break;
+      }
+
+      // Get sphere
+      const Material m (MaterialOf (idx));
+      if (kSceneHasMirrors && m.type == kMirror)
+      {
+        throughput = throughput * m.reflectance;
+        ray = Ray (info.position,
+                   ReflectAsMirror (info.outgoing, info.oriented_normal));
+        continue;
+      }
+
+      CameraHit hit;
+      hit.key      = 0;
+      hit.pixel    = queues->ray_pixels[i];
+      hit.surface  = static_cast <uint32_t> (idx);
+      hit.brdf     = throughput * m.reflectance * kInvPi;
+      hit.emission = throughput * m.emission;
+      hit.position = info.position;
+      hit.normal   = info.oriented_normal;
+      queues->hits.push_back (hit);
+      found = true;
+    }
+    if (!found)
+    {
+      queues->misses.push_back (queues->ray_pixels[i]);
+    }
+  }
+}
 /*
 // ---------------------------------------------------------------------------
+// Order the hits by surface, then along a Morton curve over the bounds of the
+// tile, so that neighbouring gathers walk the same part of the kd-tree
+// ---------------------------------------------------------------------------
 */
-int main (int argc, char *argv[])
+auto SortStage (CameraQueues* queues) -> void
 {
-  // Begin photon tracing
-  PhotonTrace ();
-  photon_map.balance ();
+  std::vector <CameraHit>& hits (queues->hits);
+  if (hits.empty ())
+  {
+    return;
+  }
 
-  //
-  RayTrace ();
+  BoundingBox bounds;
+  for (const auto& hit : hits)
+  {
+    bounds.Append (hit.position);
+  }
+  for (auto& hit : hits)
+  {
+    hit.key = MortonCode3 (hit.position, bounds);
+  }
+  std::sort (hits.begin (), hits.end (),
+             [] (const CameraHit& a, const CameraHit& b)
+             {
+               return a.surface != b.surface ? a.surface < b.surface
+                                             : a.key < b.key;
+             });
 
-  return 0;
+  queues->queries.resize (hits.size ());
+  for (size_t i = 0; i < hits.size (); ++i)
+  {
+    queues->queries[i].position = hits[i].position;
+    queues->queries[i].normal   = hits[i].normal;
+  }
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+template <typename PhotonMapType>
+auto GatherStage
+(
+  const PhotonMapType& map,
+        Float          max_dist,
+        size_t         num_photons,
+        CameraQueues*  queues
+)
+-> void
+{
+  // Indirect lighting from the photon map, all gathers in one batch. The
+  // queries keep the order of SortStage (), so the packets are its
+  // neighbourhoods.
+  map.IrradianceEstimateSorted (queues->queries,
+                                max_dist,
+                                num_photons,
+                                &queues->irradiance);
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto ShadeStage (const CameraQueues& queues, AdaptiveSampler* sampler) -> void
+{
+  for (const auto pixel : queues.misses)
+  {
+    sampler->AddSample (pixel, Vec3 (0, 0, 0));
+  }
+  for (size_t i = 0; i < queues.hits.size (); ++i)
+  {
+    const CameraHit& hit (queues.hits[i]);
+    const Vec3 direct (kDirectLighting
+                       ? DirectIrradiance (hit.position, hit.normal)
+                       : Vec3 (0, 0, 0));
+    sampler->AddSample (hit.pixel,
+                        hit.emission
+                        + (direct + queues.irradiance[i]) * hit.brdf);
+  }
+}
+/*
+// ---------------------------------------------------------------------------
+// Everything the camera pass needs which outlives a frame. Workers are
+// started once and the buffers keep their capacity from frame to frame.
+// ---------------------------------------------------------------------------
+*/
+struct RenderContext
+{
+  RenderContext () :
+    tiles_prepared      (false),
+    gather_photons      (kGatherPhotons),
+    gather_max_distance (kGatherMaxDistance),
+    refine_until_budget (false),
+    sampler (kWidth * kHeight,
+             kMaxSamplesPerPixel,
+             kPixelNoiseTarget,
+             kFrameNoiseTarget,
+             kTimeBudget),
+    tiles   ((kHeight + kTileRows - 1) / kTileRows),
+    image   (new Vec3 [kWidth * kHeight])
+  {}
+
+  ThreadPool                 pool;
+  bool                       tiles_prepared; // See PrepareTiles ()
+  uint32_t                   gather_photons;
+  Float                      gather_max_distance;
+  bool                       refine_until_budget; // Past the noise targets
+  AdaptiveSampler            sampler;
+  CameraStageTimes           stage_times;
+  std::vector <CameraQueues> tiles;
+  std::unique_ptr <Vec3 []>  image;
+  LiveFramebuffer            live;  // Opened by --live
+}; // struct RenderContext
+/*
+// ---------------------------------------------------------------------------
+// Seed the random numbers of the calling thread from a task id, so that the
+// image does not depend on which worker runs which task
+// ---------------------------------------------------------------------------
+*/
+auto SeedTask (uint32_t task) -> void
+{
+  XorShift rng;
+  rng.SetSeed ((task + 1) * 2654435761u);
+  for (int i = 0; i < 8; ++i)
+  {
+    XorShift::Next ();
+  }
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+template <typename PhotonMapType>
+auto TraceTiles
+(
+  const PhotonMapType&           map,
+  const Camera&                  camera,
+  const std::vector <uint32_t>&  tiles,
+        RenderContext*           context
+)
+-> void
+{
+  AdaptiveSampler&  sampler (context->sampler);
+  CameraStageTimes& times   (context->stage_times);
+  sampler.Reset ();
+  if (context->tiles_prepared)
+  {
+    // Keep the times of the prepared stages
+    context->pool.Wait ();
+    context->tiles_prepared = false;
+  }
+  else
+  {
+    times.Reset ();
+  }
+  if (context->live.IsOpen ())
+  {
+    context->live.BeginFrame ();
+  }
+
+  // Every task pushes a band of rows through the stages. The bands own
+  // disjoint pixels, so the sampler is shared without locking.
+  auto trace_tile = [&] (uint32_t tile, uint32_t round)
+  {
+    CameraQueues& queues (context->tiles[tile]);
+    // Prepared hits belong to this frame only, a frame which stops after
+    // round 0 must not leave them to the next one
+    const bool is_prepared (round == 0 && queues.is_prepared);
+    queues.is_prepared = false;
+    if (!is_prepared)
+    {
+      queues.Clear ();
+      SeedTask (static_cast <uint32_t> (round * context->tiles.size ()
+                                        + tile));
+      times.Time (kGenerateStage, [&] ()
+      {
+        GenerateStage (camera, tile, round, sampler, &queues);
+      });
+      times.Time (kIntersectStage, [&] () { IntersectStage (&queues); });
+      times.Time (kSortStage,      [&] () { SortStage (&queues); });
+    }
+    times.Time (kGatherStage, [&] ()
+    {
+      GatherStage (map, context->gather_max_distance,
+                   context->gather_photons, &queues);
+    });
+    times.Time (kShadeStage,     [&] () { ShadeStage (queues, &sampler); });
+    if (context->live.IsOpen ())
+    {
+      context->live.WriteTile (tile, [&sampler] (size_t pixel)
+      {
+        return sampler.Color (pixel);
+      });
+    }
+  };
+
+  // Spend more samples only on the pixels which have not converged yet. A
+  // round is not started when a round as long as the last would overrun
+  // the time budget.
+  const Float pixel_noise_target (sampler.PixelNoiseTarget ());
+  uint32_t round (0);
+  while (true)
+  {
+    const double start   (sampler.ElapsedSeconds ());
+    const double samples (sampler.AverageSamples ());
+    context->pool.ParallelFor (0, tiles.size (), [&] (size_t i)
+    {
+      trace_tile (tiles[i], round);
+    });
+    const double round_seconds (sampler.ElapsedSeconds () - start);
+    ++round;
+    if (!sampler.HasTimeFor (round_seconds))
+    {
+      break;
+    }
+    if (sampler.IsDone ())
+    {
+      // Refine a converged frame while the time lasts, unless every pixel
+      // has its maximum of samples
+      if (!context->refine_until_budget
+          || sampler.AverageSamples () == samples)
+      {
+        break;
+      }
+      sampler.SetPixelNoiseTarget (sampler.PixelNoiseTarget () * 0.5);
+    }
+  }
+  sampler.SetPixelNoiseTarget (pixel_noise_target);
+  std::cerr << round - 1 << " adaptive rounds, "
+            << sampler.AverageSamples () << " samples per pixel, "
+            << sampler.ElapsedSeconds () << " s." << std::endl;
+  times.Print (std::cerr);
+}
+/*
+// ---------------------------------------------------------------------------
+// Run the first round of every tile up to the sort stage at low priority.
+// Primary hits do not depend on the photons, so they are found while the
+// caller traces photons and balances the map. TraceTiles () waits for them
+// and only gathers and shades that round.
+// ---------------------------------------------------------------------------
+*/
+auto PrepareTiles (const Camera& camera, RenderContext* context) -> void
+{
+  context->stage_times.Reset ();
+  context->tiles_prepared = true;
+  for (uint32_t tile = 0; tile < context->tiles.size (); ++tile)
+  {
+    context->pool.Submit ([&camera, context, tile] ()
+    {
+      CameraQueues&     queues (context->tiles[tile]);
+      CameraStageTimes& times  (context->stage_times);
+      queues.Clear ();
+      SeedTask (tile);
+      times.Time (kGenerateStage, [&] ()
+      {
+        GenerateStage (camera, tile, 0, context->sampler, &queues);
+      });
+      times.Time (kIntersectStage, [&] () { IntersectStage (&queues); });
+      times.Time (kSortStage,      [&] () { SortStage (&queues); });
+      queues.is_prepared = true;
+    }, kLowPriority);
+  }
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+template <typename PhotonMapType>
+auto RayTrace
+(
+  const PhotonMapType& map,
+  const Camera&        camera,
+  const char*          filename,
+        RenderContext* context
+)
+-> bool
+{
+  std::vector <uint32_t> tiles (context->tiles.size ());
+  for (uint32_t i = 0; i < tiles.size (); ++i)
+  {
+    tiles[i] = i;
+  }
+  TraceTiles (map, camera, tiles, context);
+
+  const AdaptiveSampler& sampler (context->sampler);
+  for (uint32_t i = 0; i < kWidth * kHeight; ++i)
+  {
+    context->image[i] = sampler.Color (i);
+  }
+  return SavePpm (filename, context->image.get ());
+}
+/*
+// ---------------------------------------------------------------------------
+// Progressive preview, photon batches keep refining the image
+// ---------------------------------------------------------------------------
+*/
+auto ProgressiveRender (RenderContext* context) -> void
+{
+  DynamicPhotonMap map;
+  std::atomic <bool> finished (false);
+
+  // Trace photon batches in the background until the budget is stored
+  std::thread builder ([&map, &finished] ()
+  {
+    while (map.NumStoredPhotons () < kNumPhotons)
+    {
+      PhotonMap batch (kProgressiveBatchSize);
+      const size_t num_emitted (FillPhotonMap (&batch));
+      map.AddBatch (batch, num_emitted);
+    }
+    finished = true;
+  });
+
+  // Render a preview whenever new photons have arrived
+  size_t rendered (0);
+  while (true)
+  {
+    const bool   last (finished);
+    const size_t num_photons (map.NumStoredPhotons ());
+    if (num_photons != rendered)
+    {
+      RayTrace (map, camera, "output.ppm", context);
+      rendered = num_photons;
+      std::cerr << "Preview with " << num_photons << " photons in "
+                << map.NumTrees () << " trees." << std::endl;
+    }
+    else if (last)
+    {
+      break;
+    }
+    else
+    {
+      std::this_thread::sleep_for (std::chrono::milliseconds (10));
+    }
+  }
+  builder.join ();
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto RenderPath
+(
+  const std::vector <Camera>& cameras,
+        RenderContext*        context
+)
+-> void
+{
+  // Photons do not depend on the view, they are traced once for all frames
+  PrepareTiles (cameras[0], context);
+  PhotonTrace (&photon_map, kNumPhotons);
+  photon_map.Balance ();
+
+  char filename[32];
+  for (size_t i = 0; i < cameras.size (); ++i)
+  {
+    std::snprintf (filename, sizeof (filename), "frame_%04zu.ppm", i);
+    if (RayTrace (photon_map, cameras[i], filename, context))
+    {
+      std::cerr << "Frame " << i + 1 << "/" << cameras.size ()
+                << " saved to " << filename << "." << std::endl;
+    }
+  }
+}
+/*
+// ---------------------------------------------------------------------------
+// Wall clock time per camera sample of the first round of a few tiles,
+// gathering from the given map
+// ---------------------------------------------------------------------------
+*/
+auto PilotCameraPass
+(
+  const PhotonMap&     map,
+        uint32_t       gather_photons,
+        RenderContext* context
+)
+-> double
+{
+  const uint32_t num_tiles (static_cast <uint32_t> (context->tiles.size ()));
+  const uint32_t count     (std::min (kDeadlinePilotTiles, num_tiles));
+  std::atomic <size_t> samples (0);
+
+  const auto start (std::chrono::steady_clock::now ());
+  context->pool.ParallelFor (0, count, [&] (size_t i)
+  {
+    const uint32_t tile (static_cast <uint32_t> (i * num_tiles / count));
+    CameraQueues& queues (context->tiles[tile]);
+    queues.Clear ();
+    SeedTask (tile);
+    GenerateStage (camera, tile, 0, context->sampler, &queues);
+    IntersectStage (&queues);
+    SortStage (&queues);
+    GatherStage (map, context->gather_max_distance, gather_photons, &queues);
+    ShadeStage (queues, &context->sampler);
+    samples += queues.rays.size ();
+  });
+  const double seconds (std::chrono::duration <double>
+                        (std::chrono::steady_clock::now () - start).count ());
+  return seconds / std::max <size_t> (samples, 1);
+}
+/*
+// ---------------------------------------------------------------------------
+// Render output.ppm within a wall clock deadline. Pilot runs measure the
+// photon and the camera throughput, DeadlineController picks the photon
+// count, the gather size and the time of the camera pass from them.
+// ---------------------------------------------------------------------------
+*/
+auto DeadlineRender
+(
+  double                                deadline,
+  std::chrono::steady_clock::time_point start,
+  RenderContext*                        context
+)
+-> void
+{
+  DeadlineController controller (deadline, start);
+
+  PhotonMap pilot (kDeadlinePilotPhotons);
+  const double trace_start (controller.ElapsedSeconds ());
+  PhotonTrace (&pilot, kDeadlinePilotPhotons);
+  pilot.Balance ();
+  controller.MeasurePhotons (pilot.NumStoredPhotons (),
+                             controller.ElapsedSeconds () - trace_start);
+
+  const uint32_t k0 (std::max <uint32_t> (kGatherPhotons / 2, 8));
+  const uint32_t k1 (kGatherPhotons * 2);
+  const double   seconds0 (PilotCameraPass (pilot, k0, context));
+  const double   seconds1 (PilotCameraPass (pilot, k1, context));
+  controller.MeasureSamples (k0, seconds0, k1, seconds1);
+
+  const DeadlinePlan plan (controller.Plan ());
+  controller.Print (std::cerr, plan);
+
+  PhotonMap map (PhotonMapCapacity (plan.num_photons));
+  PrepareTiles (camera, context);
+  PhotonTrace (&map, plan.num_photons);
+  map.Balance ();
+
+  // The frame is refined until the time is up
+  context->gather_photons      = plan.gather_photons;
+  context->refine_until_budget = true;
+  context->sampler.SetTimeBudget (controller.RemainingSeconds ());
+  RayTrace (map, camera, "output.ppm", context);
+  std::cerr << "Finished after " << controller.ElapsedSeconds () << " of "
+            << deadline << " s." << std::endl;
+}
+/*
+// ---------------------------------------------------------------------------
+// Render server. Jobs come in over stdin or a Unix socket, one per line, see
+// RenderJob. The scene, the workers and the balanced photon maps of the last
+// kServerCachedMaps lighting setups stay in memory from job to job.
+//
+//   --serve [socket]  serve stdin, or the clients of the socket in turn
+//
+// Every job is answered by one line, "ok <output> <seconds> cached|traced"
+// or "error <reason>". The line "quit" stops the server.
+// ---------------------------------------------------------------------------
+*/
+struct CachedPhotonMap
+{
+  std::string                 key;
+  std::unique_ptr <PhotonMap> map;
+}; // struct CachedPhotonMap
+/*
+// ---------------------------------------------------------------------------
+// Balanced photon map of the job, traced unless it is in the cache. Photons
+// are only stored where the importance pre-pass looked, so with importance
+// the camera is part of the lighting key.
+// ---------------------------------------------------------------------------
+*/
+auto ServerPhotonMap
+(
+  const RenderJob&                     job,
+        std::deque <CachedPhotonMap>*  cache,
+        bool*                          is_cached
+)
+-> const PhotonMap&
+{
+  // The pose at full float precision, poses which differ in any bit get
+  // maps culled for their own view
+  std::ostringstream key;
+  key << std::setprecision (std::numeric_limits <Float>::max_digits10)
+      << job.num_photons;
+  if (kUseImportance)
+  {
+    const CameraPose& p (job.pose);
+    key << " " << p.position.x << " " << p.position.y << " " << p.position.z
+        << " " << p.target.x   << " " << p.target.y   << " " << p.target.z
+        << " " << p.up.x       << " " << p.up.y       << " " << p.up.z;
+  }
+
+  for (auto it = cache->begin (); it != cache->end (); ++it)
+  {
+    if (it->key == key.str ())
+    {
+      // Most recently used first
+      CachedPhotonMap hit (std::move (*it));
+      cache->erase (it);
+      cache->push_front (std::move (hit));
+      *is_cached = true;
+      return *cache->front ().map;
+    }
+  }
+
+  *is_cached = false;
+  if (kUseImportance)
+  {
+    ImportonTrace (std::vector <Camera> (1, CameraPath::ToCamera (job.pose)));
+  }
+  std::unique_ptr <PhotonMap> map
+    (new PhotonMap (PhotonMapCapacity (job.num_photons)));
+  PhotonTrace (map.get (), job.num_photons);
+  map->Balance ();
+
+  cache->push_front (CachedPhotonMap {key.str (), std::move (map)});
+  if (cache->size () > kServerCachedMaps)
+  {
+    cache->pop_back ();
+  }
+  return *cache->front ().map;
+}
+/*
+// ---------------------------------------------------------------------------
+// Render the jobs of one client
+// Return:
+//   - false if the client asked the server to quit
+// ---------------------------------------------------------------------------
+*/
+auto ServeJobs
+(
+  JobChannel*                   channel,
+  std::deque <CachedPhotonMap>* cache,
+  RenderContext*                context
+)
+-> bool
+{
+  std::string line;
+  while (channel->ReadLine (&line))
+  {
+    if (line.empty () || line[0] == '#')
+    {
+      continue;
+    }
+    if (line == "quit")
+    {
+      channel->Reply ("bye");
+      return false;
+    }
+
+    RenderJob   job;
+    std::string error;
+    if (!ParseRenderJob (line, &job, &error))
+    {
+      channel->Reply ("error " + error);
+      continue;
+    }
+
+    const auto start (std::chrono::steady_clock::now ());
+    bool is_cached (false);
+    const PhotonMap& map (ServerPhotonMap (job, cache, &is_cached));
+    context->gather_photons      = job.gather_photons;
+    context->gather_max_distance = job.gather_max_distance;
+    if (!RayTrace (map, CameraPath::ToCamera (job.pose), job.output.c_str (),
+                   context))
+    {
+      channel->Reply ("error can not write " + job.output);
+      continue;
+    }
+    const double seconds (std::chrono::duration <double>
+                          (std::chrono::steady_clock::now () - start).count ());
+
+    std::ostringstream reply;
+    reply << "ok " << job.output << " " << seconds
+          << (is_cached ? " cached" : " traced");
+    channel->Reply (reply.str ());
+  }
+  return true;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto Serve (const char* socket_path, RenderContext* context) -> bool
+{
+  std::deque <CachedPhotonMap> cache;
+  if (socket_path == nullptr)
+  {
+    JobChannel channel (STDIN_FILENO, STDOUT_FILENO, false);
+    ServeJobs (&channel, &cache, context);
+    return true;
+  }
+
+  JobListener listener (socket_path);
+  if (!listener.Listen ())
+  {
+    return false;
+  }
+  std::cerr << "Serving on " << socket_path << "." << std::endl;
+  while (true)
+  {
+    const int fd (listener.Accept ());
+    if (fd < 0)
+    {
+      std::cerr << "Can not accept a client." << std::endl;
+      return false;
+    }
+    JobChannel channel (fd, fd, true);
+    if (!ServeJobs (&channel, &cache, context))
+    {
+      return true;
+    }
+  }
+}
+/*
+// ---------------------------------------------------------------------------
+// Distributed rendering. Workers are plain processes sharing a directory,
+// on one machine or on several with a shared file system.
+//
+//   --trace-shard  <dir> <shard> <shards>    trace one slice of the photons
+//   --merge        <dir> <shards>            merge the chunks of all shards
+//   --render-tiles <dir> <worker> <workers>  render one share of the tiles
+//   --assemble     <dir> <workers>           put the tiles into output.ppm
+//   --distributed  <dir> <workers>           all of the above, locally
+// ---------------------------------------------------------------------------
+*/
+static const char kTileFileMagic[8] = {'P','M','T','I','L','E','S','1'};
+/*
+// ---------------------------------------------------------------------------
+*/
+auto WorkFile (const std::string& dir, const char* name, uint32_t index)
+  -> std::string
+{
+  char filename[32];
+  std::snprintf (filename, sizeof (filename), "%s_%04u.bin", name, index);
+  return dir + "/" + filename;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto TraceShard (const std::string& dir, uint32_t shard, uint32_t shards)
+  -> bool
+{
+  // Every shard stores its share of the photons from its own random stream
+  const size_t num_photons (kNumPhotons / shards
+                            + (shard < kNumPhotons % shards ? 1 : 0));
+  PhotonMap map (num_photons);
+  SeedTask (0x80000000u + shard);
+
+  const size_t num_emitted (FillPhotonMap (&map));
+  std::cerr << "Shard " << shard << ": " << num_emitted
+            << " photons emitted." << std::endl;
+  return WritePhotonChunk (WorkFile (dir, "photons", shard),
+                           map, shard, num_emitted);
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto MergeShards (const std::string& dir, uint32_t shards) -> bool
+{
+  // Size the merged map from the headers first
+  uint64_t num_photons (0);
+  uint64_t num_emitted (0);
+  for (uint32_t i = 0; i < shards; ++i)
+  {
+    PhotonChunkHeader header;
+    if (!ReadPhotonChunkHeader (WorkFile (dir, "photons", i), &header))
+    {
+      return false;
+    }
+    num_photons += header.num_photons;
+    num_emitted += header.num_emitted;
+  }
+
+  PhotonMap merged (num_photons);
+  for (uint32_t i = 0; i < shards; ++i)
+  {
+    PhotonChunkHeader header;
+    if (!ReadPhotonChunk (WorkFile (dir, "photons", i), &merged, &header))
+    {
+      return false;
+    }
+  }
+  std::cerr << "Merged " << num_photons << " photons of " << shards
+            << " shards, " << num_emitted << " emitted." << std::endl;
+  return WritePhotonChunk (dir + "/photons_merged.bin",
+                           merged, 0, num_emitted);
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto RenderTiles
+(
+  const std::string&   dir,
+        uint32_t       worker,
+        uint32_t       workers,
+        RenderContext* context
+)
+-> bool
+{
+  // Every worker balances the same merged photons on its own
+  PhotonChunkHeader header;
+  if (!ReadPhotonChunk (dir + "/photons_merged.bin", &photon_map, &header))
+  {
+    return false;
+  }
+  photon_map.ScalePhotonPower (1.0 / static_cast <Float> (header.num_emitted));
+  photon_map.Balance ();
+
+  // Tiles are dealt round robin, neighbouring bands cost about the same
+  std::vector <uint32_t> tiles;
+  for (uint32_t i = worker; i < context->tiles.size (); i += workers)
+  {
+    tiles.push_back (i);
+  }
+  TraceTiles (photon_map, camera, tiles, context);
+
+  //   magic, width, height, tile rows, number of tiles
+  //   tile index, RGB of its rows x number of tiles
+  const std::string filename (WorkFile (dir, "tiles", worker));
+  const std::string tmp (filename + ".tmp");
+  FILE* f = fopen (tmp.c_str (), "wb");
+  if (f == nullptr)
+  {
+    std::cerr << "Can not write " << tmp << std::endl;
+    return false;
+  }
+  const uint32_t info[4] = {kWidth, kHeight, kTileRows,
+                            static_cast <uint32_t> (tiles.size ())};
+  bool ok (fwrite (kTileFileMagic, sizeof (kTileFileMagic), 1, f) == 1
+           && fwrite (info, sizeof (info), 1, f) == 1);
+
+  std::vector <float> rgb;
+  for (const auto tile : tiles)
+  {
+    const uint32_t y_begin (tile * kTileRows);
+    const uint32_t y_end   (std::min (y_begin + kTileRows, kHeight));
+    rgb.clear ();
+    for (uint32_t y = y_begin; y < y_end; ++y)
+    {
+      for (uint32_t x = 0; x < kWidth; ++x)
+      {
+        const Vec3 c (context->sampler.Color ((kHeight - 1 - y) * kWidth + x));
+        rgb.insert (rgb.end (), {c.r, c.g, c.b});
+      }
+    }
+    ok = ok
+      && fwrite (&tile, sizeof (tile), 1, f) == 1
+      && fwrite (rgb.data (), sizeof (float), rgb.size (), f) == rgb.size ();
+  }
+  ok = (fclose (f) == 0) && ok;
+  if (!ok || std::rename (tmp.c_str (), filename.c_str ()) != 0)
+  {
+    std::cerr << "Failed to write " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto AssembleTiles
+(
+  const std::string&   dir,
+        uint32_t       workers,
+        RenderContext* context
+)
+-> bool
+{
+  std::vector <float> rgb (kTileRows * kWidth * 3);
+  for (uint32_t worker = 0; worker < workers; ++worker)
+  {
+    const std::string filename (WorkFile (dir, "tiles", worker));
+    FILE* f = fopen (filename.c_str (), "rb");
+    if (f == nullptr)
+    {
+      std::cerr << "Can not open " << filename << std::endl;
+      return false;
+    }
+
+    char     magic[8];
+    uint32_t info[4];
+    bool ok (fread (magic, sizeof (magic), 1, f) == 1
+             && fread (info, sizeof (info), 1, f) == 1
+             && std::memcmp (magic, kTileFileMagic, sizeof (magic)) == 0
+             && info[0] == kWidth && info[1] == kHeight
+             && info[2] == kTileRows);
+    for (uint32_t i = 0; ok && i < info[3]; ++i)
+    {
+      uint32_t tile;
+      ok = fread (&tile, sizeof (tile), 1, f) == 1
+        && tile < context->tiles.size ();
+      if (!ok)
+      {
+        break;
+      }
+      const uint32_t y_begin (tile * kTileRows);
+      const uint32_t y_end   (std::min (y_begin + kTileRows, kHeight));
+      const size_t   count   ((y_end - y_begin) * kWidth * 3);
+      ok = fread (rgb.data (), sizeof (float), count, f) == count;
+      for (uint32_t y = y_begin; ok && y < y_end; ++y)
+      {
+        for (uint32_t x = 0; x < kWidth; ++x)
+        {
+          const float* c (&rgb[((y - y_begin) * kWidth + x) * 3]);
+          context->image[(kHeight - 1 - y) * kWidth + x] = Vec3 (c[0], c[1], c[2]);
+        }
+      }
+    }
+    fclose (f);
+    if (!ok)
+    {
+      std::cerr << filename << " is not a valid tile file." << std::endl;
+      return false;
+    }
+  }
+  return SavePpm ("output.ppm", context->image.get ());
+}
+/*
+// ---------------------------------------------------------------------------
+// Run one phase on local worker processes and wait for all of them
+// ---------------------------------------------------------------------------
+*/
+auto RunWorkers
+(
+  const char*        program,
+  const char*        mode,
+  const std::string& dir,
+        uint32_t     workers
+)
+-> bool
+{
+#if defined (__unix__)
+  std::vector <pid_t> pids;
+  for (uint32_t i = 0; i < workers; ++i)
+  {
+    const std::string index (std::to_string (i));
+    const std::string count (std::to_string (workers));
+    const pid_t pid (fork ());
+    if (pid == 0)
+    {
+      // The workers load the same meshes
+      std::vector <const char*> args (1, program);
+      for (const auto& option : geometry_options)
+      {
+        args.push_back (option.c_str ());
+      }
+      args.insert (args.end (), {mode, dir.c_str (), index.c_str (),
+                                 count.c_str (), nullptr});
+      execv (program, const_cast <char* const*> (args.data ()));
+      std::_Exit (127);
+    }
+    if (pid < 0)
+    {
+      std::cerr << "Can not start worker " << i << std::endl;
+      break;
+    }
+    pids.push_back (pid);
+  }
+
+  bool ok (pids.size () == workers);
+  for (const auto pid : pids)
+  {
+    int status (0);
+    ok = waitpid (pid, &status, 0) == pid
+      && WIFEXITED (status) && WEXITSTATUS (status) == 0
+      && ok;
+  }
+  return ok;
+#else
+  std::cerr << "Local workers need fork (), run the phases by hand."
+            << std::endl;
+  return false;
+#endif
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto DistributedRender
+(
+  const char*          program,
+  const std::string&   dir,
+        uint32_t       workers,
+        RenderContext* context
+)
+-> bool
+{
+  return RunWorkers (program, "--trace-shard", dir, workers)
+      && MergeShards (dir, workers)
+      && RunWorkers (program, "--render-tiles", dir, workers)
+      && AssembleTiles (dir, workers, context);
+}
+/*
+// ---------------------------------------------------------------------------
+// Load the meshes given by --mesh and --instances and build their BVHs.
+// --mesh places one mesh as it is. --instances reads a list of placements,
+// one per line:
+//
+//   <mesh file> tx ty tz [scale [rotate_y [r g b]]]
+//
+// Lines starting with '#' are comments, mesh files are relative to the list.
+// Every file is loaded once however many times it is placed.
+// ---------------------------------------------------------------------------
+*/
+auto LoadMeshes (ThreadPool* pool) -> bool
+{
+  typedef std::chrono::steady_clock Clock;
+  auto seconds = [] (Clock::time_point a, Clock::time_point b)
+  {
+    return std::chrono::duration <double> (b - a).count ();
+  };
+
+  std::map <std::string, uint32_t> loaded;
+  auto load = [&] (const std::string& filename, uint32_t* mesh) -> bool
+  {
+    const auto it (loaded.find (filename));
+    if (it != loaded.end ())
+    {
+      *mesh = it->second;
+      return true;
+    }
+
+    const auto   start (Clock::now ());
+    TriangleMesh triangles;
+    if (!LoadMesh (filename, &triangles))
+    {
+      return false;
+    }
+    const auto read (Clock::now ());
+    TriangleBvh bvh;
+    bvh.Build (triangles, pool);
+    const auto built (Clock::now ());
+
+    std::cerr << filename << ": " << triangles.NumTriangles ()
+              << " triangles loaded in " << seconds (start, read)
+              << " s, BVH of " << bvh.NumNodes () << " nodes built in "
+              << seconds (read, built) << " s." << std::endl;
+    *mesh = meshes.AddMesh (std::move (bvh));
+    loaded[filename] = *mesh;
+    return true;
+  };
+
+  const Material kDefaultMaterial {Vec3 (0, 0, 0),
+                                   Vec3 (0.75, 0.75, 0.75),
+                                   kMatte};
+  for (size_t i = 0; i + 1 < geometry_options.size (); i += 2)
+  {
+    const std::string& option (geometry_options[i]);
+    const std::string& file   (geometry_options[i + 1]);
+    uint32_t mesh;
+    if (option == "--mesh")
+    {
+      if (!load (file, &mesh))
+      {
+        return false;
+      }
+      meshes.AddInstance (mesh, Transform (), kDefaultMaterial);
+      continue;
+    }
+
+    std::ifstream list (file);
+    if (!list)
+    {
+      std::cerr << "Can not open instance list " << file << std::endl;
+      return false;
+    }
+    const size_t      slash (file.rfind ('/'));
+    const std::string dir   (slash == std::string::npos
+                             ? "" : file.substr (0, slash + 1));
+    std::string line;
+    while (std::getline (list, line))
+    {
+      if (line.empty () || line[0] == '#')
+      {
+        continue;
+      }
+      std::istringstream ss (line);
+      std::string name;
+      Vec3        position;
+      if (!(ss >> name >> position.x >> position.y >> position.z))
+      {
+        continue;
+      }
+      Float    scale (1), rotate_y (0);
+      Material material (kDefaultMaterial);
+      if (ss >> scale && ss >> rotate_y)
+      {
+        Vec3 rgb;
+        if (ss >> rgb.r >> rgb.g >> rgb.b)
+        {
+          material.reflectance = rgb;
+        }
+      }
+      if (!load (name[0] == '/' ? name : dir + name, &mesh))
+      {
+        return false;
+      }
+      meshes.AddInstance (mesh,
+                          Transform::Translate (position)
+                          * Transform::RotateY (rotate_y)
+                          * Transform::Scale (scale),
+                          material);
+    }
+  }
+
+  if (!meshes.IsEmpty ())
+  {
+    const auto start (Clock::now ());
+    meshes.Build (pool);
+    std::cerr << meshes.NumMeshes () << " meshes ("
+              << meshes.MeshBytes () / (1 << 20) << " MB), "
+              << meshes.NumInstances () << " instances ("
+              << meshes.InstanceBytes () / (1 << 20) << " MB), top level "
+              << "built in " << seconds (start, Clock::now ()) << " s."
+              << std::endl;
+  }
+  return true;
+}
+/*
+// ---------------------------------------------------------------------------
+// Numbers of the command line, the whole argument must be the number
+// ---------------------------------------------------------------------------
+*/
+auto ParseCount (const char* arg, uint32_t* value) -> bool
+{
+  char* end (nullptr);
+  errno = 0;
+  const unsigned long v (std::strtoul (arg, &end, 10));
+  if (!std::isdigit (static_cast <unsigned char> (arg[0])) || *end != '\0'
+      || errno != 0 || v > std::numeric_limits <uint32_t>::max ())
+  {
+    return false;
+  }
+  *value = static_cast <uint32_t> (v);
+  return true;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto ParseSeconds (const char* arg, double* value) -> bool
+{
+  char* end (nullptr);
+  errno = 0;
+  const double v (std::strtod (arg, &end));
+  if (end == arg || *end != '\0' || errno != 0 || !(v > 0)
+      || !std::isfinite (v))
+  {
+    return false;
+  }
+  *value = v;
+  return true;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+int main (int argc, char *argv[])
+{
+  // Deadlines count from here
+  const auto start (std::chrono::steady_clock::now ());
+
+  // Leading --mesh <file> and --instances <file> options add geometry,
+  // --live <name> shows the render in a shared memory framebuffer, the rest
+  // picks the mode
+  int first (1);
+  std::string live_name;
+  while (first + 1 < argc && (std::string (argv[first]) == "--mesh"
+                              || std::string (argv[first]) == "--instances"
+                              || std::string (argv[first]) == "--live"))
+  {
+    if (std::string (argv[first]) == "--live")
+    {
+      live_name = argv[first + 1];
+    }
+    else
+    {
+      geometry_options.push_back (argv[first]);
+      geometry_options.push_back (argv[first + 1]);
+    }
+    first += 2;
+  }
+  if (first > 1)
+  {
+    argv[first - 1] = argv[0];
+    argv += first - 1;
+    argc -= first - 1;
+  }
+  const std::string mode (argc > 1 ? argv[1] : "");
+
+  // Cameras of every frame, a single frame unless a path is given
+  std::vector <Camera> cameras (1, camera);
+  if (mode == "--path")
+  {
+    CameraPath path;
+    uint32_t   frames (0);
+    if (argc < 3 || (argc > 3 && !ParseCount (argv[3], &frames))
+        || !path.Load (argv[2]))
+    {
+      std::cerr << "Usage: " << argv[0] << " --path <poses> [frames]"
+                << std::endl;
+      return 1;
+    }
+    cameras = path.Cameras (frames);
+  }
+
+  // Phases of distributed rendering which do not trace photons
+  RenderContext context;
+  if (!LoadMeshes (&context.pool))
+  {
+    return 1;
+  }
+  if (!live_name.empty ()
+      && !context.live.Open (live_name,
+                             static_cast <uint32_t> (context.tiles.size ())))
+  {
+    return 1;
+  }
+  if (mode == "--serve")
+  {
+    return Serve (argc > 2 ? argv[2] : nullptr, &context) ? 0 : 1;
+  }
+  if (mode == "--merge" || mode == "--assemble" || mode == "--distributed"
+      || mode == "--render-tiles")
+  {
+    const bool has_index (mode == "--render-tiles");
+    uint32_t   index (0), count (0);
+    if (argc < (has_index ? 5 : 4)
+        || (has_index && !ParseCount (argv[3], &index))
+        || !ParseCount (argv[has_index ? 4 : 3], &count))
+    {
+      std::cerr << "Usage: " << argv[0] << " " << mode << " <dir>"
+                << (has_index ? " <index>" : "") << " <count>" << std::endl;
+      return 1;
+    }
+    const std::string dir (argv[2]);
+    bool ok (false);
+    if      (mode == "--merge")    { ok = MergeShards (dir, count); }
+    else if (mode == "--assemble") { ok = AssembleTiles (dir, count, &context); }
+    else if (mode == "--distributed")
+    {
+      ok = DistributedRender (argv[0], dir, count, &context);
+    }
+    else
+    {
+      ok = RenderTiles (dir, index, count, &context);
+    }
+    return ok ? 0 : 1;
+  }
+
+  // Find the surfaces the cameras see before photon tracing. The pre-pass is
+  // deterministic, every shard ends up with the same emission guide.
+  if (kUseImportance)
+  {
+    ImportonTrace (cameras);
+  }
+
+  if (mode == "--trace-shard")
+  {
+    uint32_t shard (0), shards (0);
+    if (argc < 5 || !ParseCount (argv[3], &shard)
+        || !ParseCount (argv[4], &shards) || shard >= shards)
+    {
+      std::cerr << "Usage: " << argv[0] << " --trace-shard <dir> <shard>"
+                << " <shards>, shard < shards" << std::endl;
+      return 1;
+    }
+    return TraceShard (argv[2], shard, shards) ? 0 : 1;
+  }
+  if (mode == "--deadline")
+  {
+    double deadline (0);
+    if (argc < 3 || !ParseSeconds (argv[2], &deadline))
+    {
+      std::cerr << "Usage: " << argv[0] << " --deadline <seconds>"
+                << std::endl;
+      return 1;
+    }
+    DeadlineRender (deadline, start, &context);
+    return 0;
+  }
+  if (mode == "--progressive")
+  {
+    ProgressiveRender (&context);
+    return 0;
+  }
+  if (mode == "--path")
+  {
+    RenderPath (cameras, &context);
+    return 0;
+  }
+
+  // Begin photon tracing, the primary hits are found meanwhile
+  PrepareTiles (camera, &context);
+  PhotonTrace (&photon_map, kNumPhotons);
+  photon_map.Balance ();
+
+  //
+  return RayTrace (photon_map, camera, "output.ppm", &context) ? 0 : 1;
 }
 
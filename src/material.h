@@ -0,0 +1,40 @@
+#ifndef _MATERIAL_H_
+#define _MATERIAL_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+*/
+enum MaterialType
+{
+  kMatte  = 0,
+  kMirror = 1
+};
+/*
+// ---------------------------------------------------------------------------
+// Surface properties shared by every kind of geometry
+// ---------------------------------------------------------------------------
+*/
+struct Material
+{
+  Vec3         emission;
+  Vec3         reflectance;
+  MaterialType type;
+}; // struct Material
+ASSERT_RECORD_LAYOUT (Material, 2 * sizeof (Vec3) + 4, alignof (Float));
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _MATERIAL_H_
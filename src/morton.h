@@ -0,0 +1,56 @@
+#ifndef _MORTON_H_
+#define _MORTON_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#include "bounding_box.h"
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Spread the lower 21 bits of the value so that there are two zero bits
+// between each bit
+// ---------------------------------------------------------------------------
+*/
+auto SpreadBits3 (uint64_t v) -> uint64_t
+{
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x001f00000000ffffull;
+  v = (v | v << 16) & 0x001f0000ff0000ffull;
+  v = (v | v <<  8) & 0x100f00f00f00f00full;
+  v = (v | v <<  4) & 0x10c30c30c30c30c3ull;
+  v = (v | v <<  2) & 0x1249249249249249ull;
+  return v;
+}
+/*
+// ---------------------------------------------------------------------------
+// 63 bit Morton code of the position quantized over the bounds
+// ---------------------------------------------------------------------------
+*/
+auto MortonCode3 (const Vec3& position, const BoundingBox& bounds) -> uint64_t
+{
+  const Float kScale = static_cast <Float> ((1 << 21) - 1);
+
+  uint64_t code (0);
+  for (int i = 0; i < 3; ++i)
+  {
+    const Float extent (bounds.max[i] - bounds.min[i]);
+    Float f (extent > 0.0 ? (position[i] - bounds.min[i]) / extent : 0.0);
+    f = std::min <Float> (std::max <Float> (f, 0.0), 1.0);
+    code |= SpreadBits3 (static_cast <uint64_t> (f * kScale)) << i;
+  }
+  return code;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _MORTON_H_
@@ -0,0 +1,219 @@
+#ifndef _PHOTON_CHUNK_H_
+#define _PHOTON_CHUNK_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "photon_map.h"
+#include <cstdio>
+#include <cstring>
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Photon chunk file, the photons one shard of the photon tracing produced.
+//
+//   PhotonChunkHeader
+//   PhotonRecord x num_photons
+//
+// Photon power is stored unscaled, the reader divides by the number of
+// photons emitted by all the merged chunks.
+// ---------------------------------------------------------------------------
+*/
+static const char     kPhotonChunkMagic[8] = {'P','M','C','H','U','N','K','1'};
+static const uint32_t kPhotonChunkVersion  = 2; // Octahedral directions
+/*
+// ---------------------------------------------------------------------------
+*/
+struct PhotonChunkHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t shard;
+  uint64_t num_photons;
+  uint64_t num_emitted;
+}; // struct PhotonChunkHeader
+ASSERT_RECORD_LAYOUT (PhotonChunkHeader, 32, 8);
+/*
+// ---------------------------------------------------------------------------
+*/
+struct PhotonRecord
+{
+  float         position[3];
+  float         power[3];
+  unsigned char dir_u, dir_v;
+  unsigned char padding[2];
+}; // struct PhotonRecord
+ASSERT_RECORD_LAYOUT (PhotonRecord, 28, 4);
+/*
+// ---------------------------------------------------------------------------
+// Write the stored photons of the map to the file. The file is written aside
+// and renamed, so that a reader never sees a partial chunk.
+// Give:
+//   - filename, path of the chunk
+//   - map, photons with unscaled power
+//   - shard, index of the shard which traced them
+//   - num_emitted, number of photons emitted to fill the map
+// Return:
+//   - false on an I/O error
+// ---------------------------------------------------------------------------
+*/
+auto WritePhotonChunk
+(
+ const std::string& filename,
+ const PhotonMap&   map,
+       uint32_t     shard,
+       uint64_t     num_emitted
+)
+-> bool
+{
+  const std::string tmp (filename + ".tmp");
+  FILE* f = fopen (tmp.c_str (), "wb");
+  if (f == nullptr)
+  {
+    std::cerr << "Can not write " << tmp << std::endl;
+    return false;
+  }
+
+  PhotonChunkHeader header;
+  std::memcpy (header.magic, kPhotonChunkMagic, sizeof (header.magic));
+  header.version     = kPhotonChunkVersion;
+  header.shard       = shard;
+  header.num_photons = map.NumStoredPhotons ();
+  header.num_emitted = num_emitted;
+  bool ok (fwrite (&header, sizeof (header), 1, f) == 1);
+
+  // Records go out in blocks to keep the number of calls low
+  std::vector <PhotonRecord> block;
+  block.reserve (4096);
+  for (size_t i = 1; ok && i <= map.NumStoredPhotons (); ++i)
+  {
+    const Photon& p (map.StoredPhoton (i));
+    PhotonRecord r;
+    for (int k = 0; k < 3; ++k)
+    {
+      r.position[k] = p.position[k];
+      r.power[k]    = p.power[k];
+    }
+    r.dir_u      = p.dir_u;
+    r.dir_v      = p.dir_v;
+    r.padding[0] = r.padding[1] = 0;
+    block.push_back (r);
+
+    if (block.size () == block.capacity () || i == map.NumStoredPhotons ())
+    {
+      ok = fwrite (block.data (), sizeof (PhotonRecord), block.size (), f)
+        == block.size ();
+      block.clear ();
+    }
+  }
+
+  ok = (fclose (f) == 0) && ok;
+  if (!ok || std::rename (tmp.c_str (), filename.c_str ()) != 0)
+  {
+    std::cerr << "Failed to write " << filename << std::endl;
+    std::remove (tmp.c_str ());
+    return false;
+  }
+  return true;
+}
+/*
+// ---------------------------------------------------------------------------
+// Read the header of a chunk
+// ---------------------------------------------------------------------------
+*/
+auto ReadPhotonChunkHeader
+(
+ const std::string&       filename,
+       PhotonChunkHeader* header
+)
+-> bool
+{
+  FILE* f = fopen (filename.c_str (), "rb");
+  if (f == nullptr)
+  {
+    std::cerr << "Can not open " << filename << std::endl;
+    return false;
+  }
+  const bool ok (fread (header, sizeof (*header), 1, f) == 1);
+  fclose (f);
+
+  if (!ok
+      || std::memcmp (header->magic, kPhotonChunkMagic, sizeof (header->magic))
+      || header->version != kPhotonChunkVersion)
+  {
+    std::cerr << filename << " is not a photon chunk." << std::endl;
+    return false;
+  }
+  return true;
+}
+/*
+// ---------------------------------------------------------------------------
+// Append the photons of a chunk to the map
+// Give:
+//   - filename, path of the chunk
+//   - map, destination with room for the photons of the chunk
+//   - header, header of the chunk on return
+// ---------------------------------------------------------------------------
+*/
+auto ReadPhotonChunk
+(
+ const std::string&       filename,
+       PhotonMap*         map,
+       PhotonChunkHeader* header
+)
+-> bool
+{
+  if (!ReadPhotonChunkHeader (filename, header))
+  {
+    return false;
+  }
+
+  FILE* f = fopen (filename.c_str (), "rb");
+  if (f == nullptr || fseek (f, sizeof (*header), SEEK_SET) != 0)
+  {
+    std::cerr << "Can not open " << filename << std::endl;
+    if (f != nullptr) { fclose (f); }
+    return false;
+  }
+
+  std::vector <PhotonRecord> block (4096);
+  uint64_t remaining (header->num_photons);
+  bool ok (true);
+  while (ok && remaining > 0)
+  {
+    const size_t count (std::min <uint64_t> (remaining, block.size ()));
+    ok = fread (block.data (), sizeof (PhotonRecord), count, f) == count;
+    for (size_t i = 0; ok && i < count; ++i)
+    {
+      const PhotonRecord& r (block[i]);
+      ok = map->StorePhoton (Photon (Vec3 (r.position[0],
+                                           r.position[1],
+                                           r.position[2]),
+                                     Vec3 (r.power[0],
+                                           r.power[1],
+                                           r.power[2]),
+                                     r.dir_u,
+                                     r.dir_v));
+    }
+    remaining -= count;
+  }
+  fclose (f);
+
+  if (!ok)
+  {
+    std::cerr << filename << " is truncated or the map is full." << std::endl;
+  }
+  return ok;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _PHOTON_CHUNK_H_
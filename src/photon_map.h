@@ -7,6 +7,12 @@
 #include "surface_intersection_info.h"
 #include "bounding_box.h"
 #include "vec3.h"
+#include "scratch_arena.h"
+#include "fast_math.h"
+#include "random.h"
+#if defined (__unix__)
+#include <sys/mman.h>
+#endif
 /*
 // ---------------------------------------------------------------------------
 */
@@ -23,18 +29,36 @@ struct Photon
   (
    const Vec3& pos,
    const Vec3& pow,
-   unsigned char t,
-   unsigned char p
+   unsigned char u,
+   unsigned char v
   ) :
     position (pos),
     power    (pow),
-    theta    (t),
-    phi      (p)
+    dir_u    (u),
+    dir_v    (v),
+    plane    (0)
   {}
+  Photon
+  (
+   const Vec3& pos,
+   const Vec3& pow,
+   unsigned char u,
+   unsigned char v,
+   unsigned char nu,
+   unsigned char nv
+  ) :
+    position (pos),
+    power    (pow),
+    dir_u    (u),
+    dir_v    (v)
+  {
+    normal_u = nu;
+    normal_v = nv;
+  }
 
 
   /* Photon destructor */
-  virtual ~Photon () = default;
+  ~Photon () = default;
 
 
   /* Photon operators*/
@@ -49,13 +73,145 @@ struct Photon
   Vec3  position; // Where photon was intersected with diffuse surface
   Vec3  power;    // Power of photon
   // char  power[4];
-  unsigned char phi, theta;
-  short plane;    // Split axis, x = 0, y = 1, z = 2
+  unsigned char dir_u, dir_v; // Incoming direction, octahedral encoding
+  union
+  {
+    short plane;    // Split axis, x = 0, y = 1, z = 2
+    // Surface normal, octahedral encoding. Kept only until the map is
+    // balanced, Reduce () needs it and the split axis takes its place.
+    struct { unsigned char normal_u, normal_v; };
+  };
 }; // class Photon
+ASSERT_RECORD_LAYOUT (Photon, 2 * sizeof (Vec3) + 4, alignof (Float));
+/*
+// ---------------------------------------------------------------------------
+*/
+// Photon array, optionally backed by 2MB huge pages to cut TLB misses on
+// maps far larger than the last level cache
+class PhotonArrayDeleter
+{
+public:
+  PhotonArrayDeleter () : mapped_bytes_ (0) {}
+  explicit PhotonArrayDeleter (size_t mapped_bytes) :
+    mapped_bytes_ (mapped_bytes)
+  {}
+
+  auto operator () (Photon* photons) const -> void
+  {
+#if defined (__unix__)
+    if (mapped_bytes_ > 0)
+    {
+      munmap (photons, mapped_bytes_);
+      return ;
+    }
+#endif
+    delete [] photons;
+  }
+
+private:
+  size_t mapped_bytes_;
+}; // class PhotonArrayDeleter
+/*
+// ---------------------------------------------------------------------------
+*/
+typedef std::unique_ptr <Photon [], PhotonArrayDeleter> PhotonArray;
+/*
+// ---------------------------------------------------------------------------
+*/
+auto AllocatePhotons (size_t num_photons, bool huge_pages) -> PhotonArray
+{
+#if defined (__unix__)
+  if (huge_pages)
+  {
+    const size_t kHugePageSize = 2 * 1024 * 1024;
+    const size_t bytes ((sizeof (Photon) * num_photons + kHugePageSize - 1)
+                        / kHugePageSize * kHugePageSize);
+
+    // Explicit huge pages first, then transparent huge pages
+    void* ptr (MAP_FAILED);
+#if defined (MAP_HUGETLB)
+    ptr = mmap (nullptr, bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (ptr == MAP_FAILED)
+    {
+      ptr = mmap (nullptr, bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#if defined (MADV_HUGEPAGE)
+      if (ptr != MAP_FAILED)
+      {
+        madvise (ptr, bytes, MADV_HUGEPAGE);
+      }
+#endif
+    }
+
+    if (ptr != MAP_FAILED)
+    {
+      Photon* const photons (static_cast <Photon*> (ptr));
+      for (size_t i = 0; i < num_photons; ++i)
+      {
+        new (&photons[i]) Photon ();
+      }
+      return PhotonArray (photons, PhotonArrayDeleter (bytes));
+    }
+    std::cerr << "Huge pages are not available." << std::endl;
+  }
+#endif
+  return PhotonArray (new Photon[num_photons], PhotonArrayDeleter ());
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+struct GatherQuery
+{
+  Vec3 position;
+  Vec3 normal;
+}; // struct GatherQuery
+ASSERT_RECORD_LAYOUT (GatherQuery, 2 * sizeof (Vec3), alignof (Float));
+/*
+// ---------------------------------------------------------------------------
+// Summary of the photons of a kd-tree subtree, the node photon included
+// ---------------------------------------------------------------------------
+*/
+struct PhotonAggregate
+{
+  Vec3     power;     // Sum of the powers
+  Vec3     min, max;  // Bounds of the positions
+  Vec3     axis;      // Axis of a cone holding every incoming direction
+  Float    angle;     // Half angle of that cone, radians
+  uint32_t count;
+}; // struct PhotonAggregate
+ASSERT_RECORD_LAYOUT (PhotonAggregate, 4 * sizeof (Vec3) + 8, alignof (Float));
+/*
+// ---------------------------------------------------------------------------
+*/
+struct NearestPhotons
+{
+  /* NearestPhotons constructors */
+  NearestPhotons () = delete;
+  NearestPhotons (const Vec3& pos, Float max_dist, size_t max_photons) :
+    position (pos),
+    max      (max_photons),
+    found    (0),
+    got_heap (false),
+    dist2    (max_photons + 1),
+    index    (max_photons + 1)
+  {
+    dist2[0] = max_dist * max_dist;
+  }
+
+
+  /* NearestPhotons data */
+  Vec3   position; // Query position
+  size_t max;      // Number of photons to locate
+  size_t found;    // Number of photons found so far
+  bool   got_heap; // Candidates are organized as a max heap
+  std::vector <Float>         dist2; // dist2[0] is the current search radius
+  std::vector <const Photon*> index; // Candidates, 1-origin
+}; // struct NearestPhotons
 /*
 // ---------------------------------------------------------------------------
 */
-#define swap(ph,a,b) { Photon* ph2=ph[a]; ph[a]=ph[b]; ph[b]=ph2; }
 class PhotonMap
 {
   /* PhotonMap constructors */
@@ -64,18 +220,16 @@ public:
   PhotonMap (size_t max_photons) :
     kMaxPhotons         (max_photons),
     num_stored_photons_ (0),
+    num_half_stored_photons_ (0),
+    prev_scale_         (1),
     // Root of kd-tree does not have data
-    photons_            (new Photon[max_photons + 1])
-  {
-    for (int i = 0; i < 256; ++i)
-    {
-      Float angle (static_cast <Float> (i) * 256.0 * kPi);
-      cos_theta[i] = std::cos (angle);
-      sin_theta[i] = std::sin (angle);
-      cos_phi[i]   = std::cos (2.0 * angle);
-      sin_phi[i]   = std::sin (2.0 * angle);
-    }
-  };
+    layout_depth_       (0),
+    layout_blocked_     (false),
+    photons_            (AllocatePhotons (max_photons + 1, kPhotonHugePages)),
+    peak_build_bytes_   (0),
+    density_inv_cell_   (0, 0, 0),
+    density_cell_area_  (1)
+  {};
 
 
   /* PhotonMap destructor */
@@ -101,7 +255,7 @@ public:
   )
     -> bool
   {
-    if (kMaxPhotons < num_stored_photons_)
+    if (IsFull ())
     {
       // There is no enough memory space to store photon
       return false;
@@ -115,25 +269,32 @@ public:
     // Update boundingbox
     bounds_.Append (info.position);
 
-    // Reference to lookup table indices
-    int theta (std::acos (ray.direction[2]) * 256.0 / kPi);
-    p->theta = static_cast <unsigned char> (theta);
-    if (theta > 255)
-    {
-      p->theta = 255;
-    }
-
-    int phi (std::atan2 (ray.direction[1], ray.direction[0])
-                * 256.0 / (2.0 * kPi));
-    p->phi = static_cast <unsigned char> (phi);
-    if (phi > 255)
-    {
-      p->phi = 255;
-    }
+    EncodeOctahedral (ray.direction.x, ray.direction.y, ray.direction.z,
+                      &p->dir_u, &p->dir_v);
+    EncodeOctahedral (info.oriented_normal.x,
+                      info.oriented_normal.y,
+                      info.oriented_normal.z,
+                      &p->normal_u, &p->normal_v);
     return true;
   }
 
   auto Balance () -> void
+  {
+    ScratchArena arena;
+    Balance (&arena);
+  }
+
+  // Build the kd-tree in place. The only extra memory is one scratch buffer
+  // of two 32 bit indices per photon, taken from the arena.
+  // Give:
+  //   - build_aggregates, false for trees which are never gathered with
+  //     AggregateIrradianceEstimate ()
+  auto Balance
+  (
+   ScratchArena* arena,
+   bool          build_aggregates = kAggregateGather
+  )
+  -> void
   {
     if (num_stored_photons_ <= 0)
     {
@@ -141,73 +302,1123 @@ public:
       std::cerr << "No photons are stored." << std::endl;
       return ;
     }
+    if (num_stored_photons_ >= std::numeric_limits <uint32_t>::max ())
+    {
+      std::cerr << "Too many photons to balance." << std::endl;
+      return ;
+    }
 
-    // Allocate two temporary arrays
-    Photon **pa1 ((Photon**) malloc (sizeof (Photon*) * (num_stored_photons_ + 1)));
-    Photon **pa2 ((Photon**) malloc (sizeof (Photon*) * (num_stored_photons_ + 1)));
-
-    for (int i = 0; i <= num_stored_photons_; ++i)
+    // original: photon indices partitioned by the build
+    // balanced: photon index of every heap slot
+    const size_t n (num_stored_photons_ + 1);
+    uint32_t* const original (arena->Indices (2 * n));
+    uint32_t* const balanced (original + n);
+    for (size_t i = 0; i < n; ++i)
     {
-      pa2[i] = &photons_[i];
-      // printf ("%lf, %lf, %lf\n", pa2[i]->position.x, pa2[i]->position.y, pa2[i]->position.z);
-      // printf ("%lf, %lf, %lf\n", photons_[i].position.x, photons_[i].position.y, photons_[i].position.z);
+      original[i] = static_cast <uint32_t> (i);
     }
 
+    BuildDensityGrid ();
+
     std::cerr << "Begin balacing." << std::endl;
-    BalanceSegment(pa1, pa2, 1, 1, num_stored_photons_);
-    free(pa2);
+    BalanceSegment (balanced, original, 1, 1, num_stored_photons_);
     std::cerr << "Balanced doen." << std::endl;
 
-    int d, j = 1, foo = 1;
-    Photon foo_photon (photons_[j]);
+    // Move the photons into heap order by following the cycles of the
+    // permutation, a visited slot is marked by 0 which no photon uses
+    for (size_t i = 1; i <= num_stored_photons_; ++i)
+    {
+      if (balanced[i] == 0)
+      {
+        continue;
+      }
+      const Photon first (photons_[i]);
+      size_t j (i);
+      while (true)
+      {
+        const size_t from (balanced[j]);
+        balanced[j] = 0;
+        if (from == i)
+        {
+          photons_[j] = first;
+          break;
+        }
+        photons_[j] = photons_[from];
+        j = from;
+      }
+    }
+
+    num_half_stored_photons_ = num_stored_photons_ / 2;
+    layout_blocked_ = false;
+
+    peak_build_bytes_ = sizeof (Photon) * (kMaxPhotons + 1) + arena->Bytes ();
+    std::cerr << "Peak build memory " << peak_build_bytes_ / (1024 * 1024)
+              << " MB (" << arena->Bytes () / (1024 * 1024)
+              << " MB scratch)." << std::endl;
 
-    for (int i = 1; i <= num_stored_photons_; ++i)
+    if (kBlockedPhotonLayout)
     {
-      d = pa1[j] - photons_.get ();
-      pa1[j] = nullptr;
-      if (d != foo)
+      Relayout ();
+    }
+
+    if (build_aggregates)
+    {
+      BuildAggregates ();
+    }
+    else
+    {
+      aggregates_.clear ();
+    }
+  }
+
+  // Summarize every subtree of at least kAggregateMinPhotons photons, for
+  // AggregateIrradianceEstimate (). Aggregates are indexed by heap index, so
+  // they hold in either layout.
+  auto BuildAggregates () -> void
+  {
+    aggregates_.assign (num_stored_photons_ / kAggregateMinPhotons + 1,
+                        PhotonAggregate ());
+    if (num_stored_photons_ > 0)
+    {
+      BuildAggregate (1);
+    }
+  }
+
+  // Bytes held by the photons and the scratch buffer during the last build
+  auto PeakBuildBytes () const -> size_t
+  {
+    return peak_build_bytes_;
+  }
+
+  // Reorder the balanced photons so that every subtree of kPhotonBlockDepth
+  // levels is contiguous. Heap order puts every step down the tree on a new
+  // cache line below the first few levels; in blocked order most steps stay
+  // inside of the block of the parent.
+  //
+  // The levels above the deepest one form a complete tree which is cut into
+  // rows of blocks, the rows and the blocks inside of a row in heap order.
+  // The deepest, possibly partial, level stays in heap order at the end, so
+  // that no slot is wasted.
+  auto Relayout () -> void
+  {
+    if (layout_blocked_ || num_stored_photons_ < 2)
+    {
+      return ;
+    }
+
+    layout_depth_ = FloorLog2 (num_stored_photons_);
+
+    // Apply the permutation in place by following its cycles
+    std::vector <bool> done (num_stored_photons_ + 1, false);
+    for (size_t i = 1; i <= num_stored_photons_; ++i)
+    {
+      if (done[i])
       {
-        photons_[j] = photons_[d];
+        continue;
+      }
+      Photon carry (photons_[i]);
+      size_t from (i);
+      while (true)
+      {
+        const size_t to (BlockedPosition (from));
+        done[from] = true;
+        const Photon displaced (photons_[to]);
+        photons_[to] = carry;
+        carry = displaced;
+        if (to == i)
+        {
+          break;
+        }
+        from = to;
+      }
+    }
+    layout_blocked_ = true;
+  }
+
+  auto Capacity () const -> size_t
+  {
+    return kMaxPhotons;
+  }
+
+  auto IsFull () const -> bool
+  {
+    return num_stored_photons_ >= kMaxPhotons;
+  }
+
+  // Scale the power of all photons stored since the last call
+  // Give:
+  //   - scale, usually 1 / number of emitted photons
+  auto ScalePhotonPower (Float scale) -> void
+  {
+    for (size_t i = prev_scale_; i <= num_stored_photons_; ++i)
+    {
+      photons_[i].power = photons_[i].power * scale;
+    }
+    prev_scale_ = num_stored_photons_ + 1;
+  }
+
+  // Shrink the map to at most target photons, so that tracing can go on
+  // within the same memory. Must be called before Balance () and before any
+  // power is scaled.
+  // Give:
+  //   - target, number of photons to keep
+  //   - merge, true to merge the photons of a grid cell which arrive from
+  //     similar directions on similar surfaces into one photon carrying
+  //     their power. False to thin the photons by russian roulette, the
+  //     denser cells harder, the survivors carry the power of the lost ones
+  //     on average.
+  auto Reduce (size_t target, bool merge) -> void
+  {
+    if (num_stored_photons_ <= target || target == 0)
+    {
+      return ;
+    }
+    if (prev_scale_ != 1)
+    {
+      std::cerr << "Scaled photon maps can not be reduced." << std::endl;
+      return ;
+    }
+
+    // Smallest cell size giving no more groups than wanted. Thinning keeps
+    // several photons per cell, its cells only measure the density.
+    std::vector <std::pair <uint64_t, uint32_t>> keys;
+    const size_t num_groups (merge ? target
+                                   : std::max <size_t> (target / 16, 1));
+    Float extent (1e-4);
+    for (int i = 0; i < 3; ++i)
+    {
+      extent = std::max (extent, bounds_.max[i] - bounds_.min[i]);
+    }
+    Float fine (extent / kReduceCellsPerAxis), coarse (extent);
+    for (int i = 0; i < 16; ++i)
+    {
+      const Float cell (std::sqrt (fine * coarse));
+      if (SortReduceKeys (1.0 / cell, merge, &keys) > num_groups)
+      {
+        fine = cell;
       }
       else
       {
-        photons_[j] = foo_photon;
+        coarse = cell;
+      }
+    }
+    SortReduceKeys (1.0 / coarse, merge, &keys);
+
+    if (merge)
+    {
+      MergeGroups (keys);
+    }
+    else
+    {
+      ThinCells (keys, target);
+    }
+
+    bounds_ = BoundingBox ();
+    for (size_t i = 1; i <= num_stored_photons_; ++i)
+    {
+      bounds_.Append (photons_[i].position);
+    }
+
+    // The direction and normal classes may keep every merge key apart even
+    // at the coarsest cell, thinning then takes the map down to the target
+    if (merge && num_stored_photons_ > target)
+    {
+      Reduce (target, false);
+    }
+  }
+
+  // Decode the incoming direction of the photon
+  auto PhotonDirection (const Photon& p) const -> Vec3
+  {
+    return DecodeOctahedral (p.dir_u, p.dir_v);
+  }
+
+  // Estimate the irradiance at the position from the nearest photons
+  // Give:
+  //   - position
+  //   - normal, photons arriving from behind the surface are ignored
+  //   - max_dist, maximum search radius
+  //   - num_photons, number of photons used in the estimate
+  // Return:
+  //   - Irradiance
+  auto IrradianceEstimate
+  (
+   const Vec3&  position,
+   const Vec3&  normal,
+         Float  max_dist,
+         size_t num_photons
+  )
+    const -> Vec3
+  {
+    if (kAggregateGather)
+    {
+      return AggregateIrradianceEstimate (position, normal, max_dist,
+                                          num_photons);
+    }
+
+    // Start from the radius the local density suggests and widen it only
+    // when it does not hold enough photons. Every query returns the same
+    // photons as a single query with max_dist would.
+    Float radius (EstimateGatherRadius (position, num_photons, max_dist));
+    NearestPhotons np (position, radius, num_photons);
+    LocatePhotons (&np, 1);
+    while (np.found < num_photons && radius < max_dist)
+    {
+      radius = std::min (radius * 2, max_dist);
+      np = NearestPhotons (position, radius, num_photons);
+      LocatePhotons (&np, 1);
+    }
+
+    return IrradianceFromCandidates (&np, normal);
+  }
+
+  // Estimate the irradiance of many queries at once. The caller orders the
+  // queries by location, see SortStage (), and packets of neighbouring
+  // queries share a single kd-tree traversal.
+  // Give:
+  //   - queries
+  //   - max_dist, maximum search radius
+  //   - num_photons, number of photons used in each estimate
+  //   - irradiance, resized to the number of queries
+  auto IrradianceEstimateSorted
+  (
+   const std::vector <GatherQuery>& queries,
+         Float                      max_dist,
+         size_t                     num_photons,
+         std::vector <Vec3>*        irradiance
+  )
+    const -> void
+  {
+    irradiance->assign (queries.size (), Vec3 (0, 0, 0));
+    if (kAggregateGather)
+    {
+      for (size_t i = 0; i < queries.size (); ++i)
+      {
+        (*irradiance)[i] = AggregateIrradianceEstimate (queries[i].position,
+                                                        queries[i].normal,
+                                                        max_dist,
+                                                        num_photons);
+      }
+      return ;
+    }
 
-        if (i < num_stored_photons_)
+    static_assert (kGatherPacketSize <= 32, "Packet is masked by 32 bits");
+    std::vector <NearestPhotons> packet;
+    packet.reserve (kGatherPacketSize);
+    NearestPhotons* nps[kGatherPacketSize];
+
+    for (size_t begin = 0; begin < queries.size (); begin += kGatherPacketSize)
+    {
+      const size_t end (std::min <size_t> (begin + kGatherPacketSize,
+                                           queries.size ()));
+
+      packet.clear ();
+      for (size_t i = begin; i < end; ++i)
+      {
+        const Vec3& position (queries[i].position);
+        packet.emplace_back (position,
+                             EstimateGatherRadius (position,
+                                                   num_photons,
+                                                   max_dist),
+                             num_photons);
+      }
+      for (size_t i = 0; i < packet.size (); ++i)
+      {
+        nps[i] = &packet[i];
+      }
+
+      const uint32_t mask (packet.size () == 32
+                           ? 0xffffffff
+                           : (1u << packet.size ()) - 1);
+      LocatePhotonsPacket (nps, mask, 1);
+
+      for (size_t i = 0; i < packet.size (); ++i)
+      {
+        const GatherQuery& q  (queries[begin + i]);
+        NearestPhotons&    np (packet[i]);
+
+        // Rare, the initial radius was too small for this query
+        Float radius (std::sqrt (np.dist2[0]));
+        while (np.found < num_photons && radius < max_dist)
         {
-          for (; foo <= num_stored_photons_; ++foo)
-          {
-            if (pa1[foo] != nullptr)
-            {
-              break;
-            }
-            foo_photon = photons_[foo];
-            j = foo;
-          }
-          continue;
+          radius = std::min (radius * 2, max_dist);
+          np = NearestPhotons (q.position, radius, num_photons);
+          LocatePhotons (&np, 1);
         }
-        j = d;
+        (*irradiance)[begin + i] = IrradianceFromCandidates (&np, q.normal);
       }
-      free (pa1);
     }
-    num_half_stored_photons_ = num_stored_photons_ / 2 - 1;
+  }
+
+
+  // Sum up the power of the candidates arriving at the front of the surface
+  auto IrradianceFromCandidates
+  (
+         NearestPhotons* const np,
+   const Vec3&                 normal
+  )
+    const -> Vec3
+  {
+    // The radius is the farthest candidate once the list is full, even when
+    // it never overflowed into a heap
+    if (np->found == np->max && !np->got_heap)
+    {
+      np->dist2[0] = *std::max_element (np->dist2.begin () + 1,
+                                        np->dist2.begin () + np->found + 1);
+    }
+
+    // Too few photons to get a reliable estimate
+    if (np->found < 8)
+    {
+      return Vec3 (0, 0, 0);
+    }
+
+    Vec3 irradiance (0, 0, 0);
+    for (size_t i = 1; i <= np->found; ++i)
+    {
+      const Photon* const p = np->index[i];
+      // Only the side matters, the direction is not normalized
+      if (Dot (DecodeOctahedralUnnormalized (p->dir_u, p->dir_v), normal)
+          < 0.0)
+      {
+        irradiance = irradiance + p->power;
+      }
+    }
+
+    // Density estimate over the disc of the search radius
+    return irradiance * ((1.0 / kPi) / np->dist2[0]);
+  }
+
+  // Add the nearest photons of this map to the candidates, so that the
+  // candidates of several maps can be merged into one estimate
+  auto LocateNearest (NearestPhotons* const np) const -> void
+  {
+    if (num_stored_photons_ > 0)
+    {
+      LocatePhotons (np, 1);
+    }
+  }
+
+  // Same as LocateNearest () for a packet of up to 32 queries
+  auto LocateNearestPacket (NearestPhotons* const* nps, uint32_t mask) const
+    -> void
+  {
+    if (num_stored_photons_ > 0 && mask != 0)
+    {
+      LocatePhotonsPacket (nps, mask, 1);
+    }
+  }
+
+  // Append a photon as it is, used to rebuild from the photons of other maps
+  auto StorePhoton (const Photon& photon) -> bool
+  {
+    if (IsFull ())
+    {
+      return false;
+    }
+    photons_[++num_stored_photons_] = photon;
+    bounds_.Append (photon.position);
+    return true;
+  }
+
+  // Append photons in bulk, as many as there is room for
+  // Return:
+  //   - number of photons stored
+  auto StorePhotons (const Photon* photons, size_t count) -> size_t
+  {
+    count = std::min (count, kMaxPhotons - num_stored_photons_);
+    std::copy (photons, photons + count, &photons_[num_stored_photons_ + 1]);
+    for (size_t i = 0; i < count; ++i)
+    {
+      bounds_.Append (photons[i].position);
+    }
+    num_stored_photons_ += count;
+    return count;
+  }
+
+  auto NumStoredPhotons () const -> size_t
+  {
+    return num_stored_photons_;
+  }
+
+  // Stored photon in the storage order, 1-origin
+  auto StoredPhoton (size_t i) const -> const Photon&
+  {
+    return photons_[i];
+  }
+
+  // Guess the radius holding the num_photons nearest photons from the photon
+  // count of the grid cell, assuming the photons lie on a surface crossing
+  // the cell
+  auto EstimateGatherRadius
+  (
+   const Vec3&  position,
+         size_t num_photons,
+         Float  max_dist
+  )
+    const -> Float
+  {
+    // No grid before the first Balance () with photons
+    if (density_.empty ())
+    {
+      return max_dist;
+    }
+
+    int cell[3];
+    for (int i = 0; i < 3; ++i)
+    {
+      const Float f ((position[i] - density_bounds_.min[i])
+                     * density_inv_cell_[i]);
+      if (f < 0.0 || f >= static_cast <Float> (kDensityGridResolution))
+      {
+        return max_dist;
+      }
+      cell[i] = static_cast <int> (f);
+    }
+
+    const uint32_t count (density_[(cell[2] * kDensityGridResolution
+                                    + cell[1]) * kDensityGridResolution
+                                    + cell[0]]);
+    if (count == 0)
+    {
+      return max_dist;
+    }
+
+    const Float density (count / density_cell_area_);
+    const Float radius (kGatherRadiusSlack
+                        * std::sqrt (num_photons / (kPi * density)));
+    return std::min (radius, max_dist);
+  }
+
+
+  // Fixed radius estimate which takes whole subtrees at once. A subtree
+  // counts as a whole when it lies inside of the search sphere, or when it
+  // is smaller than kAggregateEpsilon times the radius and its center is
+  // inside. Subtrees whose photons all arrive from behind are skipped.
+  // The radius comes from the density grid and is widened like in
+  // IrradianceEstimate () when it holds too few photons.
+  auto AggregateIrradianceEstimate
+  (
+   const Vec3&  position,
+   const Vec3&  normal,
+         Float  max_dist,
+         size_t num_photons
+  )
+    const -> Vec3
+  {
+    Float radius (EstimateGatherRadius (position, num_photons, max_dist));
+    while (true)
+    {
+      AggregateGather gather {position, normal, radius * radius,
+                              kAggregateEpsilon * kAggregateEpsilon
+                              * radius * radius,
+                              Vec3 (0, 0, 0), 0};
+      GatherAggregated (&gather, 1);
+      if (gather.count >= num_photons || radius >= max_dist)
+      {
+        // Too few photons to get a reliable estimate
+        if (gather.count < 8)
+        {
+          return Vec3 (0, 0, 0);
+        }
+        return gather.power * ((1.0 / kPi) / gather.radius2);
+      }
+      radius = std::min (radius * 2, max_dist);
+    }
   }
 
 
   /* PhtonMap private methods */
 private:
+  struct AggregateGather
+  {
+    Vec3   position;
+    Vec3   normal;
+    Float  radius2;
+    Float  accept2;  // Squared extent of the subtrees taken as a whole
+    Vec3   power;    // Power of the photons arriving at the front
+    size_t count;    // Number of those photons
+  }; // struct AggregateGather
+
+  // Far subtrees are pruned once they are farther than the current radius
+  // over 1 + kNearestEpsilon, so every candidate found is within that
+  // factor of the true distance
+  static auto NearestPruneScale () -> Float
+  {
+    return (1 + kNearestEpsilon) * (1 + kNearestEpsilon);
+  }
+
+  // Aggregate of the subtree rooted at index, stored if it is summarized
+  auto BuildAggregate (size_t index) -> PhotonAggregate
+  {
+    const Photon& p (Node (index));
+    PhotonAggregate a;
+    a.power = p.power;
+    a.min   = p.position;
+    a.max   = p.position;
+    a.axis  = DecodeOctahedral (p.dir_u, p.dir_v);
+    a.angle = 0;
+    a.count = 1;
+
+    for (size_t child = 2 * index;
+         child <= std::min (2 * index + 1, num_stored_photons_);
+         ++child)
+    {
+      const PhotonAggregate c (BuildAggregate (child));
+      a.power = a.power + c.power;
+      for (int i = 0; i < 3; ++i)
+      {
+        a.min[i] = std::min (a.min[i], c.min[i]);
+        a.max[i] = std::max (a.max[i], c.max[i]);
+      }
+
+      // Cone around the count weighted axis holding both cones
+      const Vec3 sum (a.axis * static_cast <Float> (a.count)
+                      + c.axis * static_cast <Float> (c.count));
+      if (sum.SquaredLength () < 1e-3)
+      {
+        a.angle = kPi;
+      }
+      else
+      {
+        const Vec3 axis (Normalize (sum));
+        auto spread = [&axis] (const Vec3& v, Float angle)
+        {
+          return std::acos (std::min <Float> (std::max <Float>
+                                              (Dot (axis, v), -1), 1))
+               + angle;
+        };
+        a.angle = std::min <Float> (std::max (spread (a.axis, a.angle),
+                                              spread (c.axis, c.angle)),
+                                    kPi);
+        a.axis  = axis;
+      }
+      a.count += c.count;
+    }
+
+    if (index < aggregates_.size ())
+    {
+      aggregates_[index] = a;
+    }
+    return a;
+  }
+
+  // Add the photons of the subtree rooted at index within the radius
+  auto GatherAggregated (AggregateGather* g, size_t index) const -> void
+  {
+    if (index < aggregates_.size ())
+    {
+      const PhotonAggregate& a (aggregates_[index]);
+
+      // Squared distances to the nearest and farthest points of the bounds
+      Float near2 (0), far2 (0);
+      for (int i = 0; i < 3; ++i)
+      {
+        const Float lo (a.min[i] - g->position[i]);
+        const Float hi (a.max[i] - g->position[i]);
+        near2 += lo > 0 ? lo * lo : (hi < 0 ? hi * hi : 0);
+        far2  += std::max (lo * lo, hi * hi);
+      }
+      if (near2 >= g->radius2)
+      {
+        return ;
+      }
+
+      // Angle between the cone axis and the front of the surface
+      const Float theta (std::acos (std::min <Float> (std::max <Float>
+                                    (-Dot (a.axis, g->normal), -1), 1)));
+      if (theta - a.angle > 0.5 * kPi)
+      {
+        return ;
+      }
+      if (theta + a.angle < 0.5 * kPi)
+      {
+        const Vec3 extent (a.max - a.min);
+        const Vec3 center ((a.min + a.max) * 0.5);
+        const Vec3 d (center - g->position);
+        if (far2 < g->radius2
+            || (Dot (extent, extent) < g->accept2
+                && Dot (d, d) < g->radius2))
+        {
+          g->power  = g->power + a.power;
+          g->count += a.count;
+          return ;
+        }
+      }
+    }
+
+    const Photon& p (Node (index));
+    if (index <= num_half_stored_photons_)
+    {
+      const Float dist1 (g->position[p.plane] - p.position[p.plane]);
+      const size_t near (dist1 > 0.0 ? 2 * index + 1 : 2 * index);
+      const size_t far  (dist1 > 0.0 ? 2 * index     : 2 * index + 1);
+      if (near <= num_stored_photons_)
+      {
+        GatherAggregated (g, near);
+      }
+      if (dist1 * dist1 < g->radius2 && far <= num_stored_photons_)
+      {
+        GatherAggregated (g, far);
+      }
+    }
+
+    const Vec3 d (p.position - g->position);
+    if (Dot (d, d) < g->radius2
+        && Dot (DecodeOctahedralUnnormalized (p.dir_u, p.dir_v), g->normal)
+           < 0.0)
+    {
+      g->power = g->power + p.power;
+      ++g->count;
+    }
+  }
+
+  // Cell coordinates per axis in the keys of Reduce ()
+  static constexpr uint32_t kReduceCellsPerAxis = (1 << 14) - 1;
+
+  // Key every photon by its grid cell, and by its direction and normal
+  // classes when merging, then sort the keys
+  // Return:
+  //   - number of distinct keys
+  auto SortReduceKeys
+  (
+   Float                                         inv_cell,
+   bool                                          merge,
+   std::vector <std::pair <uint64_t, uint32_t>>* keys
+  )
+    const -> size_t
+  {
+    keys->resize (num_stored_photons_);
+    for (size_t i = 1; i <= num_stored_photons_; ++i)
+    {
+      const Photon& p (photons_[i]);
+      uint64_t key (0);
+      for (int j = 0; j < 3; ++j)
+      {
+        const Float f ((p.position[j] - bounds_.min[j]) * inv_cell);
+        key = (key << 14)
+            | std::min (static_cast <uint32_t> (std::max <Float> (f, 0)),
+                        kReduceCellsPerAxis);
+      }
+      if (merge)
+      {
+        // 8 x 8 octahedral classes, about 25 degrees wide
+        key = (key << 6) | ((p.dir_u >> 5) << 3) | (p.dir_v >> 5);
+        key = (key << 6) | ((p.normal_u >> 5) << 3) | (p.normal_v >> 5);
+      }
+      (*keys)[i - 1] = std::make_pair (key, static_cast <uint32_t> (i));
+    }
+    std::sort (keys->begin (), keys->end ());
+
+    size_t count (0);
+    for (size_t i = 0; i < keys->size (); ++i)
+    {
+      count += (i == 0 || (*keys)[i].first != (*keys)[i - 1].first);
+    }
+    return count;
+  }
+
+  // Replace every group of equal keys by one photon holding the power of
+  // the group, at the power weighted mean position and direction
+  auto MergeGroups (const std::vector <std::pair <uint64_t, uint32_t>>& keys)
+    -> void
+  {
+    std::vector <Photon> merged;
+    for (size_t begin = 0, end = 0; begin < keys.size (); begin = end)
+    {
+      for (end = begin + 1;
+           end < keys.size () && keys[end].first == keys[begin].first;
+           ++end) {}
+
+      const Photon& first (photons_[keys[begin].second]);
+      if (end - begin == 1)
+      {
+        merged.push_back (first);
+        continue;
+      }
+
+      Vec3  power (0, 0, 0), position (0, 0, 0);
+      Vec3  direction (0, 0, 0), normal (0, 0, 0);
+      Float weight (0);
+      for (size_t i = begin; i < end; ++i)
+      {
+        const Photon& p (photons_[keys[i].second]);
+        const Float w (p.power.x + p.power.y + p.power.z);
+        power     = power + p.power;
+        position  = position + p.position * w;
+        direction = direction + DecodeOctahedral (p.dir_u, p.dir_v) * w;
+        normal    = normal + DecodeOctahedral (p.normal_u, p.normal_v) * w;
+        weight   += w;
+      }
+
+      Photon p (first);
+      p.power = power;
+      if (weight > 0)
+      {
+        p.position = position * (1.0 / weight);
+      }
+      // Opposite directions cancel out, the first photon speaks for them
+      if (direction.SquaredLength () > 1e-3 * weight)
+      {
+        EncodeOctahedral (direction.x, direction.y, direction.z,
+                          &p.dir_u, &p.dir_v);
+      }
+      if (normal.SquaredLength () > 1e-3 * weight)
+      {
+        EncodeOctahedral (normal.x, normal.y, normal.z,
+                          &p.normal_u, &p.normal_v);
+      }
+      merged.push_back (p);
+    }
+
+    std::copy (merged.begin (), merged.end (), &photons_[1]);
+    num_stored_photons_ = merged.size ();
+  }
+
+  // Keep a photon with probability min (1, k / photons of its cell), k set
+  // so that about target photons survive, and divide its power by that
+  // probability
+  auto ThinCells
+  (
+   const std::vector <std::pair <uint64_t, uint32_t>>& keys,
+         size_t                                        target
+  )
+    -> void
+  {
+    std::vector <uint32_t> counts;
+    for (size_t begin = 0, end = 0; begin < keys.size (); begin = end)
+    {
+      for (end = begin + 1;
+           end < keys.size () && keys[end].first == keys[begin].first;
+           ++end) {}
+      counts.push_back (static_cast <uint32_t> (end - begin));
+    }
+
+    // The expected survivors, sum of min (count, k), grow with k
+    Float low (0), high (*std::max_element (counts.begin (), counts.end ()));
+    for (int i = 0; i < 32; ++i)
+    {
+      const Float k ((low + high) * 0.5);
+      Float kept (0);
+      for (const auto c : counts)
+      {
+        kept += std::min <Float> (c, k);
+      }
+      (kept > target ? high : low) = k;
+    }
+
+    std::vector <bool> keep (num_stored_photons_ + 1, false);
+    size_t group (0);
+    for (size_t begin = 0, end = 0; begin < keys.size (); begin = end, ++group)
+    {
+      end = begin + counts[group];
+      const Float probability (std::min <Float> (1, low / counts[group]));
+      for (size_t i = begin; i < end; ++i)
+      {
+        if (probability >= 1 || XorShift::Next01 () < probability)
+        {
+          photons_[keys[i].second].power
+            = photons_[keys[i].second].power * (1.0 / probability);
+          keep[keys[i].second] = true;
+        }
+      }
+    }
+
+    size_t num_kept (0);
+    for (size_t i = 1; i <= num_stored_photons_; ++i)
+    {
+      if (keep[i])
+      {
+        photons_[++num_kept] = photons_[i];
+      }
+    }
+    num_stored_photons_ = num_kept;
+  }
+
+  // Photon of the kd-tree node, given by its heap index
+  auto Node (size_t index) const -> const Photon&
+  {
+    return layout_blocked_ ? photons_[BlockedPosition (index)]
+                           : photons_[index];
+  }
+
+  static auto FloorLog2 (size_t v) -> int
+  {
+    return 63 - __builtin_clzll (static_cast <unsigned long long> (v));
+  }
+
+  // Position of the heap index in the blocked layout, see Relayout ()
+  auto BlockedPosition (size_t index) const -> size_t
+  {
+    const int depth (FloorLog2 (index));
+    if (depth >= layout_depth_)
+    {
+      // The deepest level stays in heap order
+      return index;
+    }
+
+    const int top    ((depth / kPhotonBlockDepth) * kPhotonBlockDepth);
+    const int height (std::min <int> (kPhotonBlockDepth, layout_depth_ - top));
+    const int rel    (depth - top);
+
+    const size_t root  (index >> rel);
+    const size_t block (root - (size_t (1) << top));
+    const size_t local (index - (root << rel) + (size_t (1) << rel));
+
+    return (size_t (1) << top)
+         + block * ((size_t (1) << height) - 1)
+         + (local - 1);
+  }
+
+  // Count the photons falling in each cell of a coarse grid over the bounds
+  auto BuildDensityGrid () -> void
+  {
+    const uint32_t res (kDensityGridResolution);
+    density_bounds_ = bounds_;
+    density_.assign (res * res * res, 0);
+
+    Float volume (1.0);
+    for (int i = 0; i < 3; ++i)
+    {
+      const Float extent (std::max <Float> (
+          density_bounds_.max[i] - density_bounds_.min[i], 1e-4));
+      density_inv_cell_[i] = res / extent;
+      volume *= extent / res;
+    }
+    density_cell_area_ = std::pow (volume, 2.0 / 3.0);
+
+    for (size_t i = 1; i <= num_stored_photons_; ++i)
+    {
+      int cell[3];
+      for (int j = 0; j < 3; ++j)
+      {
+        const Float f ((photons_[i].position[j] - density_bounds_.min[j])
+                       * density_inv_cell_[j]);
+        cell[j] = std::min (std::max (static_cast <int> (f), 0),
+                            static_cast <int> (res) - 1);
+      }
+      ++density_[(cell[2] * res + cell[1]) * res + cell[0]];
+    }
+  }
+
+  // Locate the nearest photons in the subtree rooted at index
+  auto LocatePhotons (NearestPhotons* const np, size_t index) const -> void
+  {
+    const Photon* const p = &Node (index);
+
+    // Search the subtrees, the near side first
+    if (index <= num_half_stored_photons_)
+    {
+      const Float dist1 (np->position[p->plane] - p->position[p->plane]);
+      const size_t near (dist1 > 0.0 ? 2 * index + 1 : 2 * index);
+      const size_t far  (dist1 > 0.0 ? 2 * index     : 2 * index + 1);
+
+      if (near <= num_stored_photons_)
+      {
+        LocatePhotons (np, near);
+      }
+      if (dist1 * dist1 * NearestPruneScale () < np->dist2[0]
+          && far <= num_stored_photons_)
+      {
+        LocatePhotons (np, far);
+      }
+    }
+
+    // Squared distance between the current photon and the query
+    const Vec3  d (p->position - np->position);
+    AddCandidate (np, p, Dot (d, d));
+  }
+
+  // Locate the nearest photons of several queries in one traversal
+  // Give:
+  //   - nps, queries of the packet
+  //   - mask, bit i is set if nps[i] still needs to visit this subtree
+  //   - index, root of the subtree
+  auto LocatePhotonsPacket
+  (
+   NearestPhotons* const* nps,
+   uint32_t               mask,
+   size_t                 index
+  )
+    const -> void
+  {
+    const Photon* const p = &Node (index);
+
+    if (index <= num_half_stored_photons_)
+    {
+      const int   axis  (p->plane);
+      const Float split (p->position[axis]);
+
+      // Queries on the right of the split plane have the right child near
+      uint32_t right_near (0);
+      int      votes      (0);
+      for (uint32_t m = mask; m != 0; m &= m - 1)
+      {
+        const int i (__builtin_ctz (m));
+        if (nps[i]->position[axis] > split)
+        {
+          right_near |= 1u << i;
+          ++votes;
+        }
+        else
+        {
+          --votes;
+        }
+      }
+
+      // Visit the child most of the queries are near to first
+      const bool   right_first (votes > 0);
+      const size_t first  (right_first ? 2 * index + 1 : 2 * index);
+      const size_t second (right_first ? 2 * index     : 2 * index + 1);
+      const uint32_t first_near (right_first ? right_near
+                                             : mask & ~right_near);
+
+      if (first <= num_stored_photons_)
+      {
+        const uint32_t m (first_near | InRange (nps, mask & ~first_near,
+                                                axis, split));
+        if (m != 0)
+        {
+          LocatePhotonsPacket (nps, m, first);
+        }
+      }
+      if (second <= num_stored_photons_)
+      {
+        const uint32_t m ((mask & ~first_near) | InRange (nps, first_near,
+                                                          axis, split));
+        if (m != 0)
+        {
+          LocatePhotonsPacket (nps, m, second);
+        }
+      }
+    }
+
+    for (uint32_t m = mask; m != 0; m &= m - 1)
+    {
+      NearestPhotons* const np (nps[__builtin_ctz (m)]);
+      const Vec3 d (p->position - np->position);
+      AddCandidate (np, p, Dot (d, d));
+    }
+  }
+
+  // Select the queries whose search radius crosses the split plane
+  auto InRange
+  (
+   NearestPhotons* const* nps,
+   uint32_t               mask,
+   int                    axis,
+   Float                  split
+  )
+    const -> uint32_t
+  {
+    uint32_t in_range (0);
+    for (uint32_t m = mask; m != 0; m &= m - 1)
+    {
+      const int i (__builtin_ctz (m));
+      const Float dist1 (nps[i]->position[axis] - split);
+      if (dist1 * dist1 * NearestPruneScale () < nps[i]->dist2[0])
+      {
+        in_range |= 1u << i;
+      }
+    }
+    return in_range;
+  }
+
+  // Insert the photon into the candidates if it is closer than the farthest
+  auto AddCandidate
+  (
+   NearestPhotons* const np,
+   const Photon*         p,
+   Float                 dist2
+  )
+    const -> void
+  {
+    if (dist2 >= np->dist2[0])
+    {
+      return ;
+    }
+
+    // Candidate list is not full yet, use the array as it is
+    if (np->found < np->max)
+    {
+      ++np->found;
+      np->dist2[np->found] = dist2;
+      np->index[np->found] = p;
+      return ;
+    }
+
+    // Organize the candidates as a max heap on the first overflow
+    if (!np->got_heap)
+    {
+      const size_t half_found (np->found >> 1);
+      for (size_t k = half_found; k >= 1; --k)
+      {
+        size_t parent (k);
+        const Photon* const phot (np->index[k]);
+        const Float         dst2 (np->dist2[k]);
+        while (parent <= half_found)
+        {
+          size_t j (parent + parent);
+          if (j < np->found && np->dist2[j] < np->dist2[j + 1])
+          {
+            ++j;
+          }
+          if (dst2 >= np->dist2[j])
+          {
+            break;
+          }
+          np->dist2[parent] = np->dist2[j];
+          np->index[parent] = np->index[j];
+          parent = j;
+        }
+        np->dist2[parent] = dst2;
+        np->index[parent] = phot;
+      }
+      np->got_heap = true;
+
+      // The search radius shrinks to the farthest candidate from now on
+      np->dist2[0] = np->dist2[1];
+      if (dist2 >= np->dist2[0])
+      {
+        return ;
+      }
+    }
+
+    // Replace the farthest candidate and restore the heap
+    size_t parent (1);
+    size_t j (2);
+    while (j <= np->found)
+    {
+      if (j < np->found && np->dist2[j] < np->dist2[j + 1])
+      {
+        ++j;
+      }
+      if (dist2 > np->dist2[j])
+      {
+        break;
+      }
+      np->dist2[parent] = np->dist2[j];
+      np->index[parent] = np->index[j];
+      parent = j;
+      j += j;
+    }
+    np->index[parent] = p;
+    np->dist2[parent] = dist2;
+    np->dist2[0] = np->dist2[1];
+  }
+
   auto BalanceSegment
   (
-   Photon** balanced,
-   Photon** original,
-   int index,
-   int begin,
-   int end
+   uint32_t* balanced,
+   uint32_t* original,
+   size_t    index,
+   size_t    begin,
+   size_t    end
   )
     -> void
   {
     // Midian
-    int median = 1;
+    size_t median = 1;
     while (4 * median <= (end - begin + 1))
     {
       median += median;
@@ -243,7 +1454,8 @@ private:
     SplitMedian (original, begin, end, median, axis);
 
     balanced[index] = original[median];
-    balanced[index]->plane = axis;
+    Photon& node (photons_[original[median]]);
+    node.plane = axis;
 
     // Recursively balance the left and right block
     if (median > begin)
@@ -251,7 +1463,7 @@ private:
       if (begin < median - 1)
       {
         const Float tmp (bounds_.max[axis]);
-        bounds_.max[axis] = balanced[index]->position[axis];
+        bounds_.max[axis] = node.position[axis];
         BalanceSegment (balanced, original, 2 * index, begin, median - 1);
         bounds_.max[axis] = tmp;
       }
@@ -266,7 +1478,7 @@ private:
       if (median + 1 < end)
       {
         const Float tmp (bounds_.min[axis]);
-        bounds_.min[axis] = balanced[index]->position[axis];
+        bounds_.min[axis] = node.position[axis];
         BalanceSegment (balanced, original, 2 * index + 1, median + 1, end);
         bounds_.min[axis] = tmp;
       }
@@ -279,38 +1491,42 @@ private:
 
   auto SplitMedian
   (
-   Photon** photon,
-   int      begin,
-   int      end,
-   int      median,
-   int      axis
+   uint32_t* photon,
+   size_t    begin,
+   size_t    end,
+   size_t    median,
+   int       axis
   )
     const -> void
   {
-    int left  (begin);
-    int right (end);
+    auto key = [this, photon, axis] (size_t i) -> Float
+    {
+      return photons_[photon[i]].position[axis];
+    };
+
+    size_t left  (begin);
+    size_t right (end);
 
     while (left < right)
     {
-      const float v (photon[right]->position[axis]);
-      int i = left - 1;
-      int j = right;
+      const Float v (key (right));
+      size_t i = left - 1;
+      size_t j = right;
 
       while (true)
       {
-        while (photon[++i]->position[axis] < v)
+        while (key (++i) < v)
         {}
-        while (photon[--j]->position[axis] > v && j > left)
+        while (key (--j) > v && j > left)
         {}
         if (i >= j)
         {
           break;
         }
-        swap (photon, i, j);
+        std::swap (photon[i], photon[j]);
       }
 
-      swap (photon, i, right);
-      // std::swap (photon[i], photon[right]);
+      std::swap (photon[i], photon[right]);
       if (i >= median)
       {
         right = i - 1;
@@ -323,21 +1539,28 @@ private:
   }
 
 
-
   /* PhotonMap private data */
 public:
   const size_t kMaxPhotons;
 
   size_t num_stored_photons_;
   size_t num_half_stored_photons_;
-  std::unique_ptr <Photon []> photons_;
-
-  Float sin_theta[256];
-  Float cos_theta[256];
-  Float sin_phi[256];
-  Float cos_phi[256];
+  size_t prev_scale_;
+  int         layout_depth_;   // Depth of the deepest level of the tree
+  bool        layout_blocked_; // Photons are in blocked order
+  PhotonArray photons_;
+  size_t      peak_build_bytes_;
 
   BoundingBox bounds_;
+
+  // Coarse photon density used to pick the initial gather radius
+  BoundingBox             density_bounds_;
+  Vec3                    density_inv_cell_;
+  Float                   density_cell_area_;
+  std::vector <uint32_t>  density_;
+
+  // Subtree summaries by heap index, see BuildAggregates ()
+  std::vector <PhotonAggregate> aggregates_;
 }; // class PhotonMap
 /*
 // ---------------------------------------------------------------------------
@@ -0,0 +1,102 @@
+#ifndef _PHOTON_WAVE_H_
+#define _PHOTON_WAVE_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "ray.h"
+#include "vec3.h"
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Photon rays in flight, structure of arrays. The stages of the wavefront
+// photon pass sweep over one component at a time and drop the terminated
+// rays with Compact (), so every stage works on dense arrays.
+// ---------------------------------------------------------------------------
+*/
+struct PhotonWave
+{
+  /* PhotonWave public methods */
+  auto Size () const -> size_t
+  {
+    return path.size ();
+  }
+
+  auto Resize (size_t size) -> void
+  {
+    ForEachArray ([size] (auto& a) { a.resize (size); });
+  }
+
+  auto Set (size_t i, const PhotonRay& ray, uint32_t path_index) -> void
+  {
+    ox[i] = ray.origin.x;    oy[i] = ray.origin.y;    oz[i] = ray.origin.z;
+    dx[i] = ray.direction.x; dy[i] = ray.direction.y; dz[i] = ray.direction.z;
+    fr[i] = ray.flux.r;      fg[i] = ray.flux.g;      fb[i] = ray.flux.b;
+    path[i]      = path_index;
+    is_direct[i] = 1;
+  }
+
+  auto Origin    (size_t i) const -> Vec3 { return Vec3 (ox[i], oy[i], oz[i]); }
+  auto Direction (size_t i) const -> Vec3 { return Vec3 (dx[i], dy[i], dz[i]); }
+  auto Flux      (size_t i) const -> Vec3 { return Vec3 (fr[i], fg[i], fb[i]); }
+  auto Position  (size_t i) const -> Vec3 { return Vec3 (px[i], py[i], pz[i]); }
+  auto Normal    (size_t i) const -> Vec3 { return Vec3 (nx[i], ny[i], nz[i]); }
+
+  // Keep the rays whose flag is set, in order
+  auto Compact (const std::vector <uint8_t>& keep) -> void
+  {
+    size_t size (0);
+    for (size_t i = 0; i < Size (); ++i)
+    {
+      if (keep[i])
+      {
+        ForEachArray ([i, size] (auto& a) { a[size] = a[i]; });
+        ++size;
+      }
+    }
+    Resize (size);
+  }
+
+
+  /* PhotonWave private methods */
+private:
+  template <typename F>
+  auto ForEachArray (F f) -> void
+  {
+    f (ox); f (oy); f (oz);
+    f (dx); f (dy); f (dz);
+    f (fr); f (fg); f (fb);
+    f (path); f (is_direct);
+    f (hit); f (t);
+    f (px); f (py); f (pz);
+    f (nx); f (ny); f (nz);
+  }
+
+
+  /* PhotonWave public data */
+public:
+  // Ray state
+  std::vector <Float>    ox, oy, oz;
+  std::vector <Float>    dx, dy, dz;
+  std::vector <Float>    fr, fg, fb;
+  std::vector <uint32_t> path;      // Index of the emitted photon in the wave
+  std::vector <uint8_t>  is_direct; // Still on its way from a point light
+
+  // Closest hit, filled by the intersect stage
+  std::vector <int32_t>        hit; // Index of the sphere, -1 on a miss
+  std::vector <IntersectFloat> t;
+  std::vector <Float>          px, py, pz;
+  std::vector <Float>          nx, ny, nz; // Oriented toward the ray
+}; // struct PhotonWave
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _PHOTON_WAVE_H_
@@ -6,6 +6,8 @@
 #include "vec3.h"
 #include "ray.h"
 #include "random.h"
+#include "importance_map.h"
+#include "fast_math.h"
 /*
 // ---------------------------------------------------------------------------
 */
@@ -31,7 +33,7 @@ public:
 
   /* PointLight destructor */
 public:
-  virtual ~PointLight () = default;
+  ~PointLight () = default;
 
 
   /* PointLight public operators*/
@@ -52,14 +54,68 @@ public:
     const Float phi   (kPi * XorShift::Next01 ());
 
     // Compute direction
-    const Vec3 dir (std::sin (phi) * std::cos (theta),
-                    std::sin (phi) * std::sin (theta),
-                    std::cos (phi));
+    Float sin_theta, cos_theta, sin_phi, cos_phi;
+    FastSinCos (theta, &sin_theta, &cos_theta);
+    FastSinCos (phi,   &sin_phi,   &cos_phi);
+    const Vec3 dir (sin_phi * cos_theta,
+                    sin_phi * sin_theta,
+                    cos_phi);
 
     // Store photon ray
     *ray = PhotonRay (position_, dir, emission_);
   }
 
+  // Emit the photon ray towards the directions the guide prefers. The flux is
+  // weighted by the ratio of the uniform to the guided density.
+  auto GeneratePhotonRay
+  (
+   const EmissionGuide& guide,
+         PhotonRay*     ray
+  )
+    const -> void
+  {
+    Float pdf;
+    const Float u0 (XorShift::Next01 ());
+    const Float u1 (XorShift::Next01 ());
+    const Float u2 (XorShift::Next01 ());
+    const Vec3 dir (guide.Sample (u0, u1, u2, &pdf));
+
+    *ray = PhotonRay (position_, dir, emission_ * (1.0 / (4.0 * kPi * pdf)));
+  }
+
+  // Compute the irradiance arriving at the position on a surface facing the
+  // light, the caller applies the cosine and the visibility
+  // Give:
+  //   - position
+  //   - incident, normalized direction towards the light
+  //   - distance, distance to the light
+  // Return:
+  //   - Irradiance without the cosine term
+  auto Illuminate
+  (
+   const Vec3&  position,
+         Vec3*  incident,
+         Float* distance
+  )
+    const -> Vec3
+  {
+    const Vec3  d (position_ - position);
+    const Float dist2 (Dot (d, d));
+    *distance = std::sqrt (dist2);
+    *incident = d * (1.0 / *distance);
+    return emission_ * (1.0 / (4.0 * kPi * dist2));
+  }
+
+  auto Position () const -> Vec3
+  {
+    return position_;
+  }
+
+  auto Power () const -> Vec3
+  {
+    return emission_;
+  }
+
 
   /* PointLight private data */
 private:
@@ -67,6 +123,7 @@ private:
   const Vec3 emission_;
 
 }; // class PointLight
+ASSERT_RECORD_LAYOUT (PointLight, 2 * sizeof (Vec3), alignof (Float));
 /*
 // ---------------------------------------------------------------------------
 */
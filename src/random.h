@@ -70,18 +70,19 @@ class XorShift
 
 
  private:
-  static std::uint_fast32_t x_;
-  static std::uint_fast32_t y_;
-  static std::uint_fast32_t z_;
-  static std::uint_fast32_t w_;
+  // Every thread has its own state
+  static thread_local std::uint_fast32_t x_;
+  static thread_local std::uint_fast32_t y_;
+  static thread_local std::uint_fast32_t z_;
+  static thread_local std::uint_fast32_t w_;
 };
 /*
 // ---------------------------------------------------------------------------
 */
-std::uint_fast32_t XorShift::x_ = 123456789;
-std::uint_fast32_t XorShift::y_ = 362436069;
-std::uint_fast32_t XorShift::z_ = 521288629;
-std::uint_fast32_t XorShift::w_ = 88675123;
+thread_local std::uint_fast32_t XorShift::x_ = 123456789;
+thread_local std::uint_fast32_t XorShift::y_ = 362436069;
+thread_local std::uint_fast32_t XorShift::z_ = 521288629;
+thread_local std::uint_fast32_t XorShift::w_ = 88675123;
 /*
 // ---------------------------------------------------------------------------
 */
@@ -21,7 +21,7 @@ struct Ray
     origin    (ori),
     direction (dir)
   {}
-  virtual ~Ray() = default;
+  ~Ray() = default;
 
 
   /* Ray operators */
@@ -43,7 +43,9 @@ struct Ray
 /*
 // ---------------------------------------------------------------------------
 */
-struct PhotonRay : public Ray
+// Does not derive from Ray, a derived class with members of its own is not
+// standard layout. It converts to the Ray it travels along instead.
+struct PhotonRay
 {
   /* PhotonRay constructors */
   PhotonRay () = default;
@@ -53,13 +55,14 @@ struct PhotonRay : public Ray
    const Vec3& dir,
    const Vec3& f
   ) :
-    Ray      (ori, dir),
-    flux     (f)
+    origin    (ori),
+    direction (dir),
+    flux      (f)
   {}
 
 
   /* PhotonRay destructor */
-  virtual ~PhotonRay () = default;
+  ~PhotonRay () = default;
 
 
   /* PhotonRay operators*/
@@ -69,14 +72,25 @@ struct PhotonRay : public Ray
   auto operator = (const PhotonRay&  ray) -> PhotonRay& = default;
   auto operator = (      PhotonRay&& ray) -> PhotonRay& = default;
 
+  operator Ray () const
+  {
+    return Ray (origin, direction);
+  }
+
 
   /* PhotonRay data */
+  Vec3 origin;
+  Vec3 direction;
   Vec3 flux;     // Power
-
 }; // class PhotonRay
 /*
 // ---------------------------------------------------------------------------
 */
+ASSERT_RECORD_LAYOUT (Ray,       2 * sizeof (Vec3), alignof (Float));
+ASSERT_RECORD_LAYOUT (PhotonRay, 3 * sizeof (Vec3), alignof (Float));
+/*
+// ---------------------------------------------------------------------------
+*/
 }  // namespace
 /*
 // ---------------------------------------------------------------------------
@@ -0,0 +1,338 @@
+#ifndef _RENDER_SERVER_H_
+#define _RENDER_SERVER_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#include "camera_path.h"
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <string>
+#if defined (__unix__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// One render request of the server, a line of whitespace separated fields
+//
+//   render <output> [camera px py pz tx ty tz [ux uy uz]] [size w h]
+//          [gather photons max_dist] [photons count]
+//
+// Fields which are left out keep the compiled defaults.
+// ---------------------------------------------------------------------------
+*/
+struct RenderJob
+{
+  RenderJob () :
+    pose                {Vec3 (50.0, 52.0, 220.0),
+                         Vec3 (50.0, 51.96, 219.0),
+                         Vec3 (0.0, 1.0, 0.0)},
+    width               (kWidth),
+    height              (kHeight),
+    gather_photons      (kGatherPhotons),
+    gather_max_distance (kGatherMaxDistance),
+    num_photons         (kNumPhotons)
+  {}
+
+  std::string output;
+  CameraPose  pose;
+  uint32_t    width, height;
+  uint32_t    gather_photons;
+  Float       gather_max_distance;
+  uint32_t    num_photons;
+}; // struct RenderJob
+/*
+// ---------------------------------------------------------------------------
+// Parse a job line
+// Return:
+//   - false with the reason in error if the line is not a valid job
+// ---------------------------------------------------------------------------
+*/
+auto ParseRenderJob
+(
+  const std::string& line,
+        RenderJob*   job,
+        std::string* error
+)
+-> bool
+{
+  std::istringstream ss (line);
+  std::string word;
+  if (!(ss >> word) || word != "render" || !(ss >> job->output))
+  {
+    *error = "expected render <output>";
+    return false;
+  }
+
+  while (ss >> word)
+  {
+    bool ok (false);
+    if (word == "camera")
+    {
+      CameraPose& p (job->pose);
+      ok = static_cast <bool> (ss >> p.position.x >> p.position.y
+                                  >> p.position.z >> p.target.x
+                                  >> p.target.y   >> p.target.z);
+      // The up vector is optional, the next field name is no number
+      const std::streampos mark (ss.tellg ());
+      Vec3 up;
+      if (ok && ss >> up.x >> up.y >> up.z)
+      {
+        p.up = up;
+      }
+      else if (ok)
+      {
+        ss.clear ();
+        ss.seekg (mark);
+      }
+    }
+    else if (word == "size")
+    {
+      ok = static_cast <bool> (ss >> job->width >> job->height);
+    }
+    else if (word == "gather")
+    {
+      ok = static_cast <bool> (ss >> job->gather_photons
+                                  >> job->gather_max_distance)
+        && job->gather_photons > 0 && job->gather_max_distance > 0;
+    }
+    else if (word == "photons")
+    {
+      ok = static_cast <bool> (ss >> job->num_photons)
+        && job->num_photons > 0;
+    }
+    if (!ok)
+    {
+      *error = "bad field " + word;
+      return false;
+    }
+  }
+
+  // The image buffers and the tiles are sized at compile time
+  if (job->width != kWidth || job->height != kHeight)
+  {
+    *error = "size must be " + std::to_string (kWidth) + " "
+           + std::to_string (kHeight);
+    return false;
+  }
+  return true;
+}
+/*
+// ---------------------------------------------------------------------------
+// Line based conversation with a client, over stdin and stdout or over one
+// socket connection. Jobs come in as lines, every reply goes out as a line.
+// ---------------------------------------------------------------------------
+*/
+class JobChannel
+{
+  /* JobChannel constructors */
+public:
+  JobChannel () = delete;
+  JobChannel (int in_fd, int out_fd, bool owns_fd) :
+    in_fd_   (in_fd),
+    out_fd_  (out_fd),
+    owns_fd_ (owns_fd)
+  {}
+
+
+  /* JobChannel destructor */
+public:
+  virtual ~JobChannel ()
+  {
+#if defined (__unix__)
+    if (owns_fd_)
+    {
+      close (in_fd_);
+    }
+#endif
+  }
+
+
+  /* JobChannel public operators*/
+public:
+  JobChannel (const JobChannel&  channel) = delete;
+  JobChannel (      JobChannel&& channel) = delete;
+
+  auto operator = (const JobChannel&  channel) -> JobChannel& = delete;
+  auto operator = (      JobChannel&& channel) -> JobChannel& = delete;
+
+
+  /* JobChannel public methods */
+public:
+  // Return:
+  //   - false once the client has closed the channel
+  auto ReadLine (std::string* line) -> bool
+  {
+#if defined (__unix__)
+    while (true)
+    {
+      const size_t end (buffer_.find ('\n'));
+      if (end != std::string::npos)
+      {
+        line->assign (buffer_, 0, end);
+        buffer_.erase (0, end + 1);
+        if (!line->empty () && line->back () == '\r')
+        {
+          line->pop_back ();
+        }
+        return true;
+      }
+
+      char chunk[4096];
+      const ssize_t n (read (in_fd_, chunk, sizeof (chunk)));
+      if (n <= 0)
+      {
+        // A last line without newline still counts
+        line->swap (buffer_);
+        buffer_.clear ();
+        return !line->empty ();
+      }
+      buffer_.append (chunk, n);
+    }
+#else
+    return false;
+#endif
+  }
+
+  auto Reply (const std::string& line) -> void
+  {
+#if defined (__unix__)
+    const std::string out (line + "\n");
+    size_t written (0);
+    while (written < out.size ())
+    {
+      const ssize_t n (write (out_fd_, out.data () + written,
+                              out.size () - written));
+      if (n <= 0)
+      {
+        return ;
+      }
+      written += n;
+    }
+#endif
+  }
+
+
+  /* JobChannel private data */
+private:
+  int         in_fd_;
+  int         out_fd_;
+  bool        owns_fd_;
+  std::string buffer_;  // Received bytes after the last full line
+}; // class JobChannel
+/*
+// ---------------------------------------------------------------------------
+// Listening Unix domain socket, the file is removed again on destruction
+// ---------------------------------------------------------------------------
+*/
+class JobListener
+{
+  /* JobListener constructors */
+public:
+  JobListener () = delete;
+  explicit JobListener (const std::string& path) :
+    path_ (path),
+    fd_   (-1)
+  {}
+
+
+  /* JobListener destructor */
+public:
+  virtual ~JobListener ()
+  {
+#if defined (__unix__)
+    if (fd_ >= 0)
+    {
+      close (fd_);
+      unlink (path_.c_str ());
+    }
+#endif
+  }
+
+
+  /* JobListener public operators*/
+public:
+  JobListener (const JobListener&  listener) = delete;
+  JobListener (      JobListener&& listener) = delete;
+
+  auto operator = (const JobListener&  listener) -> JobListener& = delete;
+  auto operator = (      JobListener&& listener) -> JobListener& = delete;
+
+
+  /* JobListener public methods */
+public:
+  auto Listen () -> bool
+  {
+#if defined (__unix__)
+    sockaddr_un address;
+    std::memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    if (path_.size () >= sizeof (address.sun_path))
+    {
+      std::cerr << "Socket path is too long: " << path_ << std::endl;
+      return false;
+    }
+    std::strcpy (address.sun_path, path_.c_str ());
+
+    // A client which goes away must not take the server down with it
+    std::signal (SIGPIPE, SIG_IGN);
+
+    fd_ = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0)
+    {
+      std::cerr << "Can not create a socket." << std::endl;
+      return false;
+    }
+    // A socket file left by a server which did not shut down cleanly
+    unlink (path_.c_str ());
+    if (bind (fd_, reinterpret_cast <sockaddr*> (&address),
+              sizeof (address)) != 0
+        || listen (fd_, 8) != 0)
+    {
+      std::cerr << "Can not listen on " << path_ << std::endl;
+      close (fd_);
+      fd_ = -1;
+      return false;
+    }
+    return true;
+#else
+    std::cerr << "Sockets are not supported on this platform." << std::endl;
+    return false;
+#endif
+  }
+
+  // Block until a client connects
+  // Return:
+  //   - socket of the connection, -1 on failure
+  auto Accept () -> int
+  {
+#if defined (__unix__)
+    return accept (fd_, nullptr, nullptr);
+#else
+    return -1;
+#endif
+  }
+
+
+  /* JobListener private data */
+private:
+  std::string path_;
+  int         fd_;
+}; // class JobListener
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _RENDER_SERVER_H_
@@ -0,0 +1,74 @@
+#ifndef _SCRATCH_ARENA_H_
+#define _SCRATCH_ARENA_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Scratch memory which is kept between builds, so that balancing several
+// photon maps in a row allocates once. The arena only grows.
+// ---------------------------------------------------------------------------
+*/
+class ScratchArena
+{
+  /* ScratchArena constructors */
+public:
+  ScratchArena () = default;
+
+
+  /* ScratchArena destructor */
+public:
+  virtual ~ScratchArena () = default;
+
+
+  /* ScratchArena public operators*/
+public:
+  ScratchArena (const ScratchArena&  arena) = delete;
+  ScratchArena (      ScratchArena&& arena) = default;
+
+  auto operator = (const ScratchArena&  arena) -> ScratchArena& = delete;
+  auto operator = (      ScratchArena&& arena) -> ScratchArena& = default;
+
+
+  /* ScratchArena public methods */
+public:
+  // Get a buffer of at least count indices, the content is undefined
+  auto Indices (size_t count) -> uint32_t*
+  {
+    if (indices_.size () < count)
+    {
+      indices_.resize (count);
+    }
+    return indices_.data ();
+  }
+
+  auto Bytes () const -> size_t
+  {
+    return indices_.capacity () * sizeof (uint32_t);
+  }
+
+  // Give the memory back to the system
+  auto Release () -> void
+  {
+    std::vector <uint32_t> ().swap (indices_);
+  }
+
+
+  /* ScratchArena private data */
+private:
+  std::vector <uint32_t> indices_;
+}; // class ScratchArena
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _SCRATCH_ARENA_H_
@@ -6,6 +6,10 @@
 #include "core.h"
 #include "ray.h"
 #include "vec3.h"
+#include "vec3_simd.h"
+#include "material.h"
+#include "random.h"
+#include "fast_math.h"
 #include "surface_intersection_info.h"
 /*
 // ---------------------------------------------------------------------------
@@ -15,11 +19,7 @@ namespace
 /*
 // ---------------------------------------------------------------------------
 */
-enum MaterialType
-{
-  kMatte  = 0,
-  kMirror = 1
-};
+static const IntersectFloat kSphereEpsilon = 1e-3; // Self intersection offset
 /*
 // ---------------------------------------------------------------------------
 */
@@ -45,7 +45,7 @@ public:
 
   /* Sphere destructor */
 public:
-  virtual ~Sphere () = default;
+  ~Sphere () = default;
 
 
   /* Sphere public operators*/
@@ -59,6 +59,42 @@ public:
 
   /* Sphere public methods */
 public:
+  auto GetMaterial () const -> Material
+  {
+    return Material {emission_, reflectance_, type_};
+  }
+
+  auto IsEmissive () const -> bool
+  {
+    return emission_.r > 0.0 || emission_.g > 0.0 || emission_.b > 0.0;
+  }
+
+  // Total power of a diffuse emitter, pi times the area times the radiance
+  auto Power () const -> Vec3
+  {
+    return emission_ * (4.0 * kPi * kPi * radius_ * radius_);
+  }
+
+  // Emit a photon from a uniformly chosen point, cosine weighted around the
+  // outward normal. The flux is the power of the whole sphere, the caller
+  // divides by the number of emitted photons.
+  auto GeneratePhotonRay (PhotonRay* ray) const -> void
+  {
+    const Float z   (1.0 - 2.0 * XorShift::Next01 ());
+    const Float r   (std::sqrt (std::max <Float> (0.0, 1.0 - z * z)));
+    Float sin_phi, cos_phi;
+    FastSinCos (2.0 * kPi * XorShift::Next01 (), &sin_phi, &cos_phi);
+    const Vec3 normal (r * cos_phi, r * sin_phi, z);
+
+    Vec3 tangent, binormal;
+    BuildOrthoNormalBasis (normal, &tangent, &binormal);
+    const Vec3 d (SampleCosineHemisphere (XorShift::Next01 (),
+                                          XorShift::Next01 ()));
+    *ray = PhotonRay (center_ + normal * radius_,
+                      tangent * d.x + binormal * d.y + normal * d.z,
+                      Power ());
+  }
+
   auto IsIntersect
   (
    const Ray& ray,
@@ -66,41 +102,76 @@ public:
   )
   const -> bool
   {
-    const Float kSphereEpsilon = 1e-5;
-
-    const Vec3  tmp (center_ - ray.origin);
-    const Float b (Dot (tmp, ray.direction));
-    const Float c (b * b - Dot (tmp, tmp) + radius_ * radius_);
-
-    // No intersection
-    if (c < 0.0) { return false; }
-
-    const Float sqrt_c (std::sqrt (c));
-    const Float t1 (b - sqrt_c);
-    const Float t2 (b + sqrt_c);
-    // No intersection
-    if (t1 < kSphereEpsilon && t2 < kSphereEpsilon)
+    IntersectFloat t1, t2;
+    if (!SolveQuadratic (ray, &t1, &t2))
     {
       return false;
     }
+    const IntersectFloat t (t1 > kSphereEpsilon ? t1 : t2);
 
     // Intersected
-    // Compute position where ray intersected with sphere, normal
-    auto lambda = [&ray] (Float t) -> Vec3
-    {
-      return ray.origin + ray.direction * t;
-    };
+    // Compute position where ray intersected with sphere, normal. The
+    // position is found at the intersection precision as well.
+    const Vec3A <IntersectFloat> position
+      (Vec3A <IntersectFloat> (ray.origin)
+       + Vec3A <IntersectFloat> (ray.direction) * t);
 
     // Initialize surface intersection info
-    info->position        = t1 > kSphereEpsilon ? lambda (t1) : lambda (t2);
-    info->oriented_normal = Normalize (info->position - center_);
+    info->position        = Vec3 (position.Store ());
+    const Vec3 normal (Normalize (info->position - center_));
+    info->oriented_normal = Dot (normal, ray.direction) < 0.0
+                          ? normal : -1.0 * normal;
     info->outgoing        = Normalize (-1.0 * ray.direction);
-    info->t               = t1 > kSphereEpsilon ? t1 : t2;
+    info->t               = t;
 
     return true;
   }
 
 
+  // Any hit test, only answers whether the ray hits the sphere in (0, t_max)
+  auto IsOccluded (const Ray& ray, Float t_max) const -> bool
+  {
+    IntersectFloat t1, t2;
+    if (!SolveQuadratic (ray, &t1, &t2))
+    {
+      return false;
+    }
+    return (t1 > kSphereEpsilon && t1 < t_max)
+        || (t2 > kSphereEpsilon && t2 < t_max);
+  }
+
+
+  /* Sphere private methods */
+private:
+  // Solve the ray-sphere quadratic at IntersectFloat precision, the walls
+  // are huge spheres and the quadratic cancels out most of the float
+  // precision
+  // Return:
+  //   - false if the sphere is missed or lies behind the ray
+  auto SolveQuadratic
+  (
+   const Ray&            ray,
+         IntersectFloat* t1,
+         IntersectFloat* t2
+  )
+  const -> bool
+  {
+    typedef Vec3A <IntersectFloat> V;
+    const V              oc (V (center_) - V (ray.origin));
+    const IntersectFloat b  (Dot (oc, V (ray.direction)));
+    const IntersectFloat r  (radius_);
+    const IntersectFloat c  (b * b - Dot (oc, oc) + r * r);
+
+    // No intersection
+    if (c < 0.0) { return false; }
+
+    const IntersectFloat sqrt_c (std::sqrt (c));
+    *t1 = b - sqrt_c;
+    *t2 = b + sqrt_c;
+    return *t1 >= kSphereEpsilon || *t2 >= kSphereEpsilon;
+  }
+
+
   /* Sphere private data */
 private:
 
@@ -115,6 +186,7 @@ public:
   const Vec3 emission_;
   const Vec3 reflectance_;
 }; // class Sphere
+ASSERT_RECORD_LAYOUT (Sphere, 3 * sizeof (Vec3) + 8, alignof (Float));
 /*
 // ---------------------------------------------------------------------------
 */
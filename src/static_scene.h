@@ -0,0 +1,292 @@
+#ifndef _STATIC_SCENE_H_
+#define _STATIC_SCENE_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "ray.h"
+#include "vec3.h"
+#include "vec3_simd.h"
+#include "material.h"
+#include "sphere.h"
+#include "surface_intersection_info.h"
+#include <type_traits>
+#include <vector>
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Sphere of a scene which is fixed at compile time. The center and the radius
+// are kept at Float like in Sphere so that both give the same hits, the
+// square of the radius is precomputed at IntersectFloat precision.
+// ---------------------------------------------------------------------------
+*/
+struct StaticSphere
+{
+  constexpr StaticSphere
+  (
+   Float x, Float y, Float z,
+   Float r,
+   Float er, Float eg, Float eb,
+   Float rr, Float rg, Float rb,
+   MaterialType t
+  ) :
+    center      {x, y, z},
+    radius      (r),
+    radius2     (static_cast <IntersectFloat> (r) * r),
+    emission    {er, eg, eb},
+    reflectance {rr, rg, rb},
+    type        (t)
+  {}
+
+  auto GetMaterial () const -> Material
+  {
+    return Material {Vec3 (emission[0], emission[1], emission[2]),
+                     Vec3 (reflectance[0], reflectance[1], reflectance[2]),
+                     type};
+  }
+
+  auto ToSphere () const -> Sphere
+  {
+    return Sphere (Vec3 (center[0], center[1], center[2]), radius,
+                   Vec3 (emission[0], emission[1], emission[2]),
+                   Vec3 (reflectance[0], reflectance[1], reflectance[2]),
+                   type);
+  }
+
+  Float          center[3];
+  Float          radius;
+  IntersectFloat radius2;
+  Float          emission[3];
+  Float          reflectance[3];
+  MaterialType   type;
+}; // struct StaticSphere
+/*
+// ---------------------------------------------------------------------------
+// Ray-sphere quadratic of Sphere::SolveQuadratic, with the sphere given as
+// constants
+// Return:
+//   - false if the sphere is missed or lies behind the ray
+// ---------------------------------------------------------------------------
+*/
+auto SolveStaticQuadratic
+(
+ const StaticSphere&           s,
+ const Vec3A <IntersectFloat>& origin,
+ const Vec3A <IntersectFloat>& direction,
+       IntersectFloat*         t1,
+       IntersectFloat*         t2
+)
+-> bool
+{
+  typedef Vec3A <IntersectFloat> V;
+  const V              oc (V (s.center[0], s.center[1], s.center[2]) - origin);
+  const IntersectFloat b  (Dot (oc, direction));
+  const IntersectFloat c  (b * b - Dot (oc, oc) + s.radius2);
+
+  // No intersection
+  if (c < 0.0) { return false; }
+
+  const IntersectFloat sqrt_c (std::sqrt (c));
+  *t1 = b - sqrt_c;
+  *t2 = b + sqrt_c;
+  return *t1 >= kSphereEpsilon || *t2 >= kSphereEpsilon;
+}
+/*
+// ---------------------------------------------------------------------------
+// Loop over the spheres I, I + 1, ... of a static scene, unrolled at compile
+// time. Every step reads its sphere as a constant expression, the compiler
+// folds the centers and radii into the code.
+// ---------------------------------------------------------------------------
+*/
+template <typename Scene, size_t I, bool kIsEnd = (I == Scene::kSize)>
+struct StaticSceneLoop
+{
+  // Closest hit, the distance is compared at Float like in IsIntersect ()
+  // Give:
+  //   - t, nearest Float distance so far
+  //   - t_hit, the same distance at IntersectFloat precision
+  //   - hit, index of the nearest sphere so far
+  static auto Closest
+  (
+   const Vec3A <IntersectFloat>& origin,
+   const Vec3A <IntersectFloat>& direction,
+         Float*                  t,
+         IntersectFloat*         t_hit,
+         int*                    hit
+  )
+  -> void
+  {
+    constexpr StaticSphere s (Scene::At (I));
+    IntersectFloat t1, t2;
+    if (SolveStaticQuadratic (s, origin, direction, &t1, &t2))
+    {
+      const IntersectFloat ti (t1 > kSphereEpsilon ? t1 : t2);
+      if (static_cast <Float> (ti) < *t)
+      {
+        *t     = static_cast <Float> (ti);
+        *t_hit = ti;
+        *hit   = static_cast <int> (I);
+      }
+    }
+    StaticSceneLoop <Scene, I + 1>::Closest (origin, direction, t, t_hit, hit);
+  }
+
+  static auto IsOccluded
+  (
+   const Vec3A <IntersectFloat>& origin,
+   const Vec3A <IntersectFloat>& direction,
+         Float                   t_max
+  )
+  -> bool
+  {
+    constexpr StaticSphere s (Scene::At (I));
+    IntersectFloat t1, t2;
+    if (SolveStaticQuadratic (s, origin, direction, &t1, &t2)
+        && ((t1 > kSphereEpsilon && t1 < t_max)
+         || (t2 > kSphereEpsilon && t2 < t_max)))
+    {
+      return true;
+    }
+    return StaticSceneLoop <Scene, I + 1>::IsOccluded (origin, direction,
+                                                       t_max);
+  }
+
+  // f is called with std::integral_constant <size_t, I>, so that it can
+  // read Scene::At (I) as a constant expression itself
+  template <typename F>
+  static auto ForEach (F& f) -> void
+  {
+    f (std::integral_constant <size_t, I> ());
+    StaticSceneLoop <Scene, I + 1>::ForEach (f);
+  }
+}; // struct StaticSceneLoop
+/*
+// ---------------------------------------------------------------------------
+*/
+template <typename Scene, size_t I>
+struct StaticSceneLoop <Scene, I, true>
+{
+  static auto Closest
+  (
+   const Vec3A <IntersectFloat>&,
+   const Vec3A <IntersectFloat>&,
+         Float*,
+         IntersectFloat*,
+         int*
+  )
+  -> void
+  {}
+
+  static auto IsOccluded
+  (
+   const Vec3A <IntersectFloat>&,
+   const Vec3A <IntersectFloat>&,
+         Float
+  )
+  -> bool
+  {
+    return false;
+  }
+
+  template <typename F>
+  static auto ForEach (F&) -> void
+  {}
+}; // struct StaticSceneLoop
+/*
+// ---------------------------------------------------------------------------
+// Intersection and materials of a small scene fixed at compile time. Scene
+// is a traits class with
+//
+//   static constexpr size_t kSize;
+//   static constexpr auto At (size_t i) -> StaticSphere;
+//
+// The hits are the same as the loop over Sphere, the surface information is
+// only computed for the nearest sphere.
+// ---------------------------------------------------------------------------
+*/
+template <typename Scene>
+class StaticScene
+{
+  /* StaticScene public methods */
+public:
+  // Return:
+  //   - index of the nearest sphere nearer than info->t, -1 if there is none
+  static auto Intersect (const Ray& ray, SurfaceIntersectionInfo* info) -> int
+  {
+    typedef Vec3A <IntersectFloat> V;
+    const V origin    (ray.origin);
+    const V direction (ray.direction);
+
+    Float          t     (info->t);
+    IntersectFloat t_hit (0);
+    int            hit   (-1);
+    StaticSceneLoop <Scene, 0>::Closest (origin, direction, &t, &t_hit, &hit);
+    if (hit < 0)
+    {
+      return -1;
+    }
+
+    // Surface information as computed by Sphere::IsIntersect ()
+    const StaticSphere& s (Scene::At (hit));
+    const V position (origin + direction * t_hit);
+    info->position        = Vec3 (position.Store ());
+    const Vec3 normal (Normalize (info->position
+                                  - Vec3 (s.center[0], s.center[1],
+                                          s.center[2])));
+    info->oriented_normal = Dot (normal, ray.direction) < 0.0
+                          ? normal : -1.0 * normal;
+    info->outgoing        = Normalize (-1.0 * ray.direction);
+    info->t               = t;
+    return hit;
+  }
+
+  static auto IsOccluded (const Ray& ray, Float t_max) -> bool
+  {
+    typedef Vec3A <IntersectFloat> V;
+    return StaticSceneLoop <Scene, 0>::IsOccluded (V (ray.origin),
+                                                   V (ray.direction), t_max);
+  }
+
+  template <typename F>
+  static auto ForEach (F f) -> void
+  {
+    StaticSceneLoop <Scene, 0>::ForEach (f);
+  }
+
+  static auto GetMaterial (size_t i) -> Material
+  {
+    return Scene::At (i).GetMaterial ();
+  }
+
+  // Whether a sphere of the scene has the material type, usable in constant
+  // expressions to compile material branches out
+  static constexpr auto Contains (MaterialType type, size_t i = 0) -> bool
+  {
+    return i < Scene::kSize
+        && (Scene::At (i).type == type || Contains (type, i + 1));
+  }
+
+  // Spheres for the code which works on the runtime scene, such as the
+  // light sampler
+  static auto MakeSpheres () -> std::vector <Sphere>
+  {
+    std::vector <Sphere> spheres;
+    for (size_t i = 0; i < Scene::kSize; ++i)
+    {
+      spheres.push_back (Scene::At (i).ToSphere ());
+    }
+    return spheres;
+  }
+}; // class StaticScene
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _STATIC_SCENE_H_
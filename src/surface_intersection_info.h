@@ -26,7 +26,7 @@ struct SurfaceIntersectionInfo
 
 
   /* SurfaceIntersectionInfo destructor */
-  virtual ~SurfaceIntersectionInfo () = default;
+  ~SurfaceIntersectionInfo () = default;
 
 
   /* SurfaceIntersectionInfo operators*/
@@ -45,6 +45,9 @@ struct SurfaceIntersectionInfo
   Vec3   outgoing;        // Ray direction
   Float  t;               // Parameter 't' to compute the intersected position
 }; // class SurfaceIntersectionInfo
+ASSERT_RECORD_LAYOUT (SurfaceIntersectionInfo,
+                      3 * sizeof (Vec3) + sizeof (Float),
+                      alignof (Float));
 /*
 // ---------------------------------------------------------------------------
 */
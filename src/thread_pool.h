@@ -0,0 +1,203 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Queued high priority tasks run before any low priority one. Low priority
+// tasks fill idle workers with work which is not needed yet, they never
+// take the last worker, so that the thread submitting them can go on with
+// its own work without oversubscribing the cores.
+// ---------------------------------------------------------------------------
+*/
+enum TaskPriority
+{
+  kHighPriority,
+  kLowPriority,
+  kNumTaskPriorities
+}; // enum TaskPriority
+/*
+// ---------------------------------------------------------------------------
+// Fixed set of worker threads which lives as long as the renderer, so that
+// frames and passes do not pay for thread creation.
+// ---------------------------------------------------------------------------
+*/
+class ThreadPool
+{
+  /* ThreadPool constructors */
+public:
+  ThreadPool () : ThreadPool (std::thread::hardware_concurrency ()) {}
+  explicit ThreadPool (size_t num_threads) :
+    stop_        (false),
+    pending_     (0),
+    low_running_ (0)
+  {
+    num_threads = std::max <size_t> (num_threads, 1);
+    max_low_running_ = std::max <size_t> (num_threads - 1, 1);
+    for (size_t i = 0; i < num_threads; ++i)
+    {
+      workers_.emplace_back ([this] () { Work (); });
+    }
+  }
+
+
+  /* ThreadPool destructor */
+public:
+  virtual ~ThreadPool ()
+  {
+    {
+      std::lock_guard <std::mutex> lock (mutex_);
+      stop_ = true;
+    }
+    task_ready_.notify_all ();
+    for (auto& worker : workers_)
+    {
+      worker.join ();
+    }
+  }
+
+
+  /* ThreadPool public operators*/
+public:
+  ThreadPool (const ThreadPool&  pool) = delete;
+  ThreadPool (      ThreadPool&& pool) = delete;
+
+  auto operator = (const ThreadPool&  pool) -> ThreadPool& = delete;
+  auto operator = (      ThreadPool&& pool) -> ThreadPool& = delete;
+
+
+  /* ThreadPool public methods */
+public:
+  auto NumThreads () const -> size_t
+  {
+    return workers_.size ();
+  }
+
+  auto Submit
+  (
+   std::function <void ()> task,
+   TaskPriority            priority = kHighPriority
+  )
+    -> void
+  {
+    {
+      std::lock_guard <std::mutex> lock (mutex_);
+      tasks_[priority].push_back (std::move (task));
+      ++pending_;
+    }
+    task_ready_.notify_one ();
+  }
+
+  // Block until every submitted task has finished
+  auto Wait () -> void
+  {
+    std::unique_lock <std::mutex> lock (mutex_);
+    all_done_.wait (lock, [this] () { return pending_ == 0; });
+  }
+
+  // Run body (i) for i in [begin, end) and wait for all of them
+  auto ParallelFor
+  (
+   size_t                              begin,
+   size_t                              end,
+   const std::function <void (size_t)>& body
+  )
+    -> void
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      Submit ([&body, i] () { body (i); });
+    }
+    Wait ();
+  }
+
+
+  /* ThreadPool private methods */
+private:
+  // Priority of the next task a worker may take, kNumTaskPriorities if none
+  auto NextPriority () const -> TaskPriority
+  {
+    if (!tasks_[kHighPriority].empty ())
+    {
+      return kHighPriority;
+    }
+    if (!tasks_[kLowPriority].empty () && low_running_ < max_low_running_)
+    {
+      return kLowPriority;
+    }
+    return kNumTaskPriorities;
+  }
+
+  auto Work () -> void
+  {
+    while (true)
+    {
+      std::function <void ()> task;
+      TaskPriority priority;
+      {
+        std::unique_lock <std::mutex> lock (mutex_);
+        task_ready_.wait (lock, [this] ()
+        {
+          return stop_ || NextPriority () != kNumTaskPriorities;
+        });
+        priority = NextPriority ();
+        if (stop_ && priority == kNumTaskPriorities)
+        {
+          return ;
+        }
+        task = std::move (tasks_[priority].front ());
+        tasks_[priority].pop_front ();
+        low_running_ += priority == kLowPriority;
+      }
+
+      task ();
+
+      {
+        std::lock_guard <std::mutex> lock (mutex_);
+        if (priority == kLowPriority)
+        {
+          // Another low priority task may run now
+          --low_running_;
+          task_ready_.notify_one ();
+        }
+        if (--pending_ == 0)
+        {
+          all_done_.notify_all ();
+        }
+      }
+    }
+  }
+
+
+  /* ThreadPool private data */
+private:
+  std::vector <std::thread>           workers_;
+  std::deque <std::function <void ()>> tasks_[kNumTaskPriorities];
+  std::mutex                          mutex_;
+  std::condition_variable             task_ready_;
+  std::condition_variable             all_done_;
+  bool                                stop_;
+  size_t                              pending_;
+  size_t                              low_running_;
+  size_t                              max_low_running_;
+}; // class ThreadPool
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _THREAD_POOL_H_
@@ -0,0 +1,459 @@
+#ifndef _TRIANGLE_MESH_H_
+#define _TRIANGLE_MESH_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Indexed triangle mesh in flat arrays, three floats per vertex and three
+// indices per triangle. The loaders below append to the arrays while they
+// read, no per-face objects are ever built.
+// ---------------------------------------------------------------------------
+*/
+class TriangleMesh
+{
+  /* TriangleMesh constructors */
+public:
+  TriangleMesh () = default;
+
+
+  /* TriangleMesh destructor */
+public:
+  ~TriangleMesh () = default;
+
+
+  /* TriangleMesh public operators*/
+public:
+  TriangleMesh (const TriangleMesh&  mesh) = default;
+  TriangleMesh (      TriangleMesh&& mesh) = default;
+
+  auto operator = (const TriangleMesh&  mesh) -> TriangleMesh& = default;
+  auto operator = (      TriangleMesh&& mesh) -> TriangleMesh& = default;
+
+
+  /* TriangleMesh public methods */
+public:
+  auto NumVertices () const -> size_t
+  {
+    return positions_.size () / 3;
+  }
+
+  auto NumTriangles () const -> size_t
+  {
+    return indices_.size () / 3;
+  }
+
+  auto Vertex (size_t i) const -> Vec3
+  {
+    return Vec3 (positions_[3 * i], positions_[3 * i + 1], positions_[3 * i + 2]);
+  }
+
+  auto Triangle (size_t i, Vec3* v0, Vec3* v1, Vec3* v2) const -> void
+  {
+    *v0 = Vertex (indices_[3 * i]);
+    *v1 = Vertex (indices_[3 * i + 1]);
+    *v2 = Vertex (indices_[3 * i + 2]);
+  }
+
+  auto Reserve (size_t num_vertices, size_t num_triangles) -> void
+  {
+    positions_.reserve (3 * num_vertices);
+    indices_.reserve (3 * num_triangles);
+  }
+
+  auto AddVertex (Float x, Float y, Float z) -> void
+  {
+    positions_.push_back (x);
+    positions_.push_back (y);
+    positions_.push_back (z);
+  }
+
+  auto AddTriangle (uint32_t i0, uint32_t i1, uint32_t i2) -> void
+  {
+    indices_.push_back (i0);
+    indices_.push_back (i1);
+    indices_.push_back (i2);
+  }
+
+  // Fan triangulation of a convex polygon
+  auto AddPolygon (const std::vector <uint32_t>& polygon) -> void
+  {
+    for (size_t i = 2; i < polygon.size (); ++i)
+    {
+      AddTriangle (polygon[0], polygon[i - 1], polygon[i]);
+    }
+  }
+
+  // Return:
+  //   - false if a triangle refers to a vertex which does not exist
+  auto IsValid () const -> bool
+  {
+    const size_t num_vertices (NumVertices ());
+    for (const auto i : indices_)
+    {
+      if (i >= num_vertices)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  auto Clear () -> void
+  {
+    positions_.clear ();
+    indices_.clear ();
+  }
+
+
+  /* TriangleMesh private data */
+private:
+  std::vector <Float>    positions_;
+  std::vector <uint32_t> indices_;
+}; // class TriangleMesh
+/*
+// ---------------------------------------------------------------------------
+// Wavefront OBJ, only the "v" and "f" statements are read. Faces may use the
+// v/vt/vn forms and negative indices, polygons are fanned into triangles.
+// ---------------------------------------------------------------------------
+*/
+auto LoadObj (const std::string& filename, TriangleMesh* mesh) -> bool
+{
+  FILE* f (fopen (filename.c_str (), "r"));
+  if (f == nullptr)
+  {
+    std::cerr << "Can not open " << filename << std::endl;
+    return false;
+  }
+
+  char                   line[4096];
+  std::vector <uint32_t> polygon;
+  bool                   ok (true);
+  while (ok && fgets (line, sizeof (line), f) != nullptr)
+  {
+    const char* p (line);
+    while (*p == ' ' || *p == '\t') { ++p; }
+
+    if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+    {
+      char* end;
+      const Float x (std::strtof (p + 1, &end));
+      const Float y (std::strtof (end,   &end));
+      const Float z (std::strtof (end,   &end));
+      mesh->AddVertex (x, y, z);
+    }
+    else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+    {
+      polygon.clear ();
+      const long num_vertices (static_cast <long> (mesh->NumVertices ()));
+      for (++p; ; )
+      {
+        char* end;
+        const long i (std::strtol (p, &end, 10));
+        if (end == p)
+        {
+          break;
+        }
+        // Skip the texture and normal indices of the corner
+        for (p = end; *p != '\0' && !std::isspace (static_cast <uint8_t> (*p));)
+        {
+          ++p;
+        }
+
+        const long index (i > 0 ? i - 1 : num_vertices + i);
+        if (i == 0 || index < 0)
+        {
+          ok = false;
+          break;
+        }
+        polygon.push_back (static_cast <uint32_t> (index));
+      }
+      mesh->AddPolygon (polygon);
+    }
+  }
+  fclose (f);
+
+  if (!ok || !mesh->IsValid ())
+  {
+    std::cerr << filename << " has a face with an invalid index." << std::endl;
+    return false;
+  }
+  return true;
+}
+/*
+// ---------------------------------------------------------------------------
+// Stanford PLY, ascii and binary of either endianness. The x, y, z
+// properties of the "vertex" element and the first list of the "face"
+// element are read, every other element and property is skipped.
+// ---------------------------------------------------------------------------
+*/
+static const size_t kPlyMaxListSize = 1 << 16; // Longest list of a property
+/*
+// ---------------------------------------------------------------------------
+*/
+struct PlyProperty
+{
+  std::string name;
+  char        kind;       // 'i', 'u' or 'f'
+  int         size;       // Bytes
+  bool        is_list;
+  char        count_kind; // Type of the list length
+  int         count_size;
+}; // struct PlyProperty
+/*
+// ---------------------------------------------------------------------------
+*/
+struct PlyElement
+{
+  std::string                name;
+  size_t                     count;
+  std::vector <PlyProperty>  properties;
+}; // struct PlyElement
+/*
+// ---------------------------------------------------------------------------
+*/
+auto ParsePlyType (const std::string& type, char* kind, int* size) -> bool
+{
+  static const struct { const char* name; char kind; int size; } kTypes[] =
+  {
+    {"char",  'i', 1}, {"int8",    'i', 1}, {"uchar",   'u', 1},
+    {"uint8", 'u', 1}, {"short",   'i', 2}, {"int16",   'i', 2},
+    {"ushort",'u', 2}, {"uint16",  'u', 2}, {"int",     'i', 4},
+    {"int32", 'i', 4}, {"uint",    'u', 4}, {"uint32",  'u', 4},
+    {"float", 'f', 4}, {"float32", 'f', 4}, {"double",  'f', 8},
+    {"float64", 'f', 8}
+  };
+  for (const auto& t : kTypes)
+  {
+    if (type == t.name)
+    {
+      *kind = t.kind;
+      *size = t.size;
+      return true;
+    }
+  }
+  return false;
+}
+/*
+// ---------------------------------------------------------------------------
+// Read one value of a PLY body
+// Give:
+//   - format, 0 for ascii, 1 for little endian, 2 for big endian
+// ---------------------------------------------------------------------------
+*/
+auto ReadPlyValue (FILE* f, int format, char kind, int size, double* value)
+  -> bool
+{
+  if (format == 0)
+  {
+    return fscanf (f, "%lf", value) == 1;
+  }
+
+  unsigned char b[8];
+  if (fread (b, 1, size, f) != static_cast <size_t> (size))
+  {
+    return false;
+  }
+  const uint16_t kOne (1);
+  const bool host_little (*reinterpret_cast <const unsigned char*> (&kOne) == 1);
+  if (host_little != (format == 1))
+  {
+    std::reverse (b, b + size);
+  }
+
+  switch (size * 4 + (kind == 'f' ? 2 : kind == 'i' ? 1 : 0))
+  {
+    case  4: { uint8_t  v; memcpy (&v, b, 1); *value = v; return true; }
+    case  5: { int8_t   v; memcpy (&v, b, 1); *value = v; return true; }
+    case  8: { uint16_t v; memcpy (&v, b, 2); *value = v; return true; }
+    case  9: { int16_t  v; memcpy (&v, b, 2); *value = v; return true; }
+    case 16: { uint32_t v; memcpy (&v, b, 4); *value = v; return true; }
+    case 17: { int32_t  v; memcpy (&v, b, 4); *value = v; return true; }
+    case 18: { float    v; memcpy (&v, b, 4); *value = v; return true; }
+    case 34: { double   v; memcpy (&v, b, 8); *value = v; return true; }
+  }
+  return false;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+auto LoadPly (const std::string& filename, TriangleMesh* mesh) -> bool
+{
+  FILE* f (fopen (filename.c_str (), "rb"));
+  if (f == nullptr)
+  {
+    std::cerr << "Can not open " << filename << std::endl;
+    return false;
+  }
+  fseek (f, 0, SEEK_END);
+  const long file_bytes (std::max (ftell (f), 0L));
+  rewind (f);
+
+  // Header
+  char                      line[1024];
+  int                       format (-1);
+  std::vector <PlyElement>  elements;
+  bool                      ok (fgets (line, sizeof (line), f) != nullptr
+                                && strncmp (line, "ply", 3) == 0);
+  while (ok && fgets (line, sizeof (line), f) != nullptr)
+  {
+    char word[64], a[64], b[64], c[64], d[64];
+    const int n (sscanf (line, "%63s %63s %63s %63s %63s", word, a, b, c, d));
+    if (n <= 0)
+    {
+      continue;
+    }
+    const std::string keyword (word);
+    if (keyword == "end_header")
+    {
+      break;
+    }
+    if (keyword == "format" && n >= 2)
+    {
+      const std::string name (a);
+      format = name == "ascii"                ? 0
+             : name == "binary_little_endian" ? 1
+             : name == "binary_big_endian"    ? 2
+             : -1;
+      ok = format >= 0;
+    }
+    else if (keyword == "element" && n >= 3)
+    {
+      char* end (nullptr);
+      errno = 0;
+      const unsigned long count (strtoul (b, &end, 10));
+      ok = isdigit (static_cast <unsigned char> (b[0])) && *end == '\0'
+        && errno == 0;
+      elements.push_back (PlyElement {a, count, {}});
+    }
+    else if (keyword == "property" && n >= 3 && !elements.empty ())
+    {
+      PlyProperty property {};
+      if (std::string (a) == "list" && n >= 5)
+      {
+        property.is_list = true;
+        property.name    = d;
+        ok = ParsePlyType (b, &property.count_kind, &property.count_size)
+          && ParsePlyType (c, &property.kind,       &property.size);
+      }
+      else
+      {
+        property.name = b;
+        ok = ParsePlyType (a, &property.kind, &property.size);
+      }
+      elements.back ().properties.push_back (property);
+    }
+  }
+  ok = ok && format >= 0;
+
+  // Body
+  std::vector <double>   values;
+  std::vector <uint32_t> polygon;
+  for (size_t e = 0; ok && e < elements.size (); ++e)
+  {
+    const PlyElement& element (elements[e]);
+    const bool is_vertex (element.name == "vertex");
+    const bool is_face   (element.name == "face");
+    // The count comes from the header, every property of a vertex takes a
+    // byte at least, so the file bounds what is worth reserving
+    if (is_vertex && !element.properties.empty ())
+    {
+      mesh->Reserve (std::min <size_t> (element.count,
+                                        file_bytes
+                                        / element.properties.size ()), 0);
+    }
+
+    for (size_t i = 0; ok && i < element.count; ++i)
+    {
+      values.assign (3, 0.0);
+      bool face_read (false);
+      for (const auto& property : element.properties)
+      {
+        if (!property.is_list)
+        {
+          double v;
+          ok = ok && ReadPlyValue (f, format, property.kind, property.size,
+                                   &v);
+          if      (property.name == "x") { values[0] = v; }
+          else if (property.name == "y") { values[1] = v; }
+          else if (property.name == "z") { values[2] = v; }
+          continue;
+        }
+
+        double count (0);
+        ok = ok && ReadPlyValue (f, format, property.count_kind,
+                                 property.count_size, &count)
+                && count >= 0 && count <= kPlyMaxListSize;
+        polygon.clear ();
+        for (size_t k = 0; ok && k < static_cast <size_t> (count); ++k)
+        {
+          double v;
+          ok = ReadPlyValue (f, format, property.kind, property.size, &v)
+            && v >= 0 && v <= std::numeric_limits <uint32_t>::max ();
+          polygon.push_back (ok ? static_cast <uint32_t> (v) : 0);
+        }
+        if (ok && is_face && !face_read)
+        {
+          mesh->AddPolygon (polygon);
+          face_read = true;
+        }
+        if (!ok) { break; }
+      }
+      if (ok && is_vertex)
+      {
+        mesh->AddVertex (static_cast <Float> (values[0]),
+                         static_cast <Float> (values[1]),
+                         static_cast <Float> (values[2]));
+      }
+    }
+  }
+  fclose (f);
+
+  if (!ok || !mesh->IsValid ())
+  {
+    std::cerr << filename << " is not a valid PLY file." << std::endl;
+    return false;
+  }
+  return true;
+}
+/*
+// ---------------------------------------------------------------------------
+// Pick the loader from the file extension
+// ---------------------------------------------------------------------------
+*/
+auto LoadMesh (const std::string& filename, TriangleMesh* mesh) -> bool
+{
+  const size_t dot (filename.rfind ('.'));
+  std::string extension (dot == std::string::npos ? "" : filename.substr (dot));
+  for (auto& c : extension)
+  {
+    c = static_cast <char> (std::tolower (c));
+  }
+
+  if (extension == ".obj") { return LoadObj (filename, mesh); }
+  if (extension == ".ply") { return LoadPly (filename, mesh); }
+  std::cerr << filename << ": unknown mesh format." << std::endl;
+  return false;
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _TRIANGLE_MESH_H_
@@ -11,37 +11,55 @@ namespace
 {
 /*
 // ---------------------------------------------------------------------------
+// Packed three component vector, the storage type of every record. The
+// scalar type picks the precision, Vec3 and IntersectVec3 are declared in
+// core.h. See Vec3A for the SIMD lane layout.
+// ---------------------------------------------------------------------------
 */
-class Vec3
+template <typename T>
+class Vec3T
 {
-  /* Vec3 constructors */
+  /* Vec3T public types */
 public:
-  Vec3 () = default;
-  Vec3 (Float _x, Float _y, Float _z) :
+  typedef T Scalar;
+
+
+  /* Vec3T constructors */
+public:
+  Vec3T () = default;
+  Vec3T (T _x, T _y, T _z) :
     x (_x), y (_y), z (_z)
   {}
 
-  /* Vec3 destructor */
+  // Change of precision
+  template <typename U>
+  explicit Vec3T (const Vec3T <U>& v) :
+    x (static_cast <T> (v.x)),
+    y (static_cast <T> (v.y)),
+    z (static_cast <T> (v.z))
+  {}
+
+  /* Vec3T destructor */
 public:
-  virtual ~Vec3 () = default;;
+  ~Vec3T () = default;
 
 
-  /* Vec3 public operators*/
+  /* Vec3T public operators*/
 public:
-  Vec3 (const Vec3&  vec3) = default;
-  Vec3 (      Vec3&& vec3) = default;
+  Vec3T (const Vec3T&  vec3) = default;
+  Vec3T (      Vec3T&& vec3) = default;
 
-  auto operator = (const Vec3&  vec3) -> Vec3& = default;
-  auto operator = (      Vec3&& vec3) -> Vec3& = default;
+  auto operator = (const Vec3T&  vec3) -> Vec3T& = default;
+  auto operator = (      Vec3T&& vec3) -> Vec3T& = default;
 
-  auto operator [] (size_t idx) -> Float&
+  auto operator [] (size_t idx) -> T&
   {
     if (idx == 0) { return x; }
     if (idx == 1) { return y; }
     return z;
   }
 
-  auto operator [] (size_t idx) const -> Float
+  auto operator [] (size_t idx) const -> T
   {
     if (idx == 0) { return x; }
     if (idx == 1) { return y; }
@@ -49,113 +67,132 @@ public:
   }
 
 
-  /* Vec3 public methods */
-  auto SquaredLength () const -> Float
+  /* Vec3T public methods */
+  auto SquaredLength () const -> T
   {
     return std::sqrt (this->Length ());
   }
 
-  auto Length () const -> Float
+  auto Length () const -> T
   {
     return x * x + y * y + z * z;
   }
 
 
-  /* Vec3f public data */
+  /* Vec3T public data */
   union
   {
-    struct { Float x, y, z; };
-    struct { Float r, g, b; };
+    struct { T x, y, z; };
+    struct { T r, g, b; };
   };
-}; // class Vec3
+}; // class Vec3T
 /*
 // ---------------------------------------------------------------------------
 */
-auto operator + (const Vec3& v0, const Vec3& v1) -> Vec3
+ASSERT_RECORD_LAYOUT (Vec3T <float>,  3 * sizeof (float),  alignof (float));
+ASSERT_RECORD_LAYOUT (Vec3T <double>, 3 * sizeof (double), alignof (double));
+/*
+// ---------------------------------------------------------------------------
+// The scalar operands are not deduced, so that a double literal scales a
+// float vector as before
+// ---------------------------------------------------------------------------
+*/
+template <typename T>
+auto operator + (const Vec3T <T>& v0, const Vec3T <T>& v1) -> Vec3T <T>
 {
-  return Vec3 (v0.x + v1.x, v0.y + v1.y, v0.z + v1.z);
+  return Vec3T <T> (v0.x + v1.x, v0.y + v1.y, v0.z + v1.z);
 }
 /*
 // ---------------------------------------------------------------------------
 */
-auto operator - (const Vec3& v0, const Vec3& v1) -> Vec3
+template <typename T>
+auto operator - (const Vec3T <T>& v0, const Vec3T <T>& v1) -> Vec3T <T>
 {
-  return Vec3 (v0.x - v1.x, v0.y - v1.y, v0.z - v1.z);
+  return Vec3T <T> (v0.x - v1.x, v0.y - v1.y, v0.z - v1.z);
 }
 /*
 // ---------------------------------------------------------------------------
 */
-auto operator * (const Vec3& v0, const Vec3& v1) -> Vec3
+template <typename T>
+auto operator * (const Vec3T <T>& v0, const Vec3T <T>& v1) -> Vec3T <T>
 {
-  return Vec3 (v0.x * v1.x, v0.y * v1.y, v0.z * v1.z);
+  return Vec3T <T> (v0.x * v1.x, v0.y * v1.y, v0.z * v1.z);
 }
 /*
 // ---------------------------------------------------------------------------
 */
-auto operator * (const Vec3& v, Float t) -> Vec3
+template <typename T>
+auto operator * (const Vec3T <T>& v, typename Vec3T <T>::Scalar t)
+  -> Vec3T <T>
 {
-  return Vec3 (v.x * t, v.y * t, v.z * t);
+  return Vec3T <T> (v.x * t, v.y * t, v.z * t);
 }
 /*
 // ---------------------------------------------------------------------------
 */
-auto operator * (Float t, const Vec3& v) -> Vec3
+template <typename T>
+auto operator * (typename Vec3T <T>::Scalar t, const Vec3T <T>& v)
+  -> Vec3T <T>
 {
-  return Vec3 (v.x * t, v.y * t, v.z * t);
+  return Vec3T <T> (v.x * t, v.y * t, v.z * t);
 }
 /*
 // ---------------------------------------------------------------------------
 */
-auto Normalize (const Vec3& v) -> Vec3
+template <typename T>
+auto Normalize (const Vec3T <T>& v) -> Vec3T <T>
 {
-  const Float inv (1.0 / v.SquaredLength ());
+  const T inv (1.0 / v.SquaredLength ());
   return v * inv;
 }
 /*
 // ---------------------------------------------------------------------------
 */
-auto Dot (const Vec3& v0, const Vec3& v1) -> Float
+template <typename T>
+auto Dot (const Vec3T <T>& v0, const Vec3T <T>& v1) -> T
 {
   return v0.x * v1.x + v0.y * v1.y + v0.z * v1.z;
 }
 /*
 // ---------------------------------------------------------------------------
 */
-auto Cross (const Vec3& v0, const Vec3& v1) -> Vec3
+template <typename T>
+auto Cross (const Vec3T <T>& v0, const Vec3T <T>& v1) -> Vec3T <T>
 {
-  return Vec3 (v0.y * v1.z - v0.z * v1.y,
-               v0.z * v1.x - v0.x * v1.z,
-               v0.x * v1.y - v0.y * v1.x);
+  return Vec3T <T> (v0.y * v1.z - v0.z * v1.y,
+                    v0.z * v1.x - v0.x * v1.z,
+                    v0.x * v1.y - v0.y * v1.x);
 }
 /*
 // ---------------------------------------------------------------------------
 */
+template <typename T>
 auto BuildOrthoNormalBasis
 (
- const Vec3& normal,
-       Vec3* tangent,
-       Vec3* binormal
+ const Vec3T <T>& normal,
+       Vec3T <T>* tangent,
+       Vec3T <T>* binormal
 )
 -> void
 {
   if(normal.z < 0.0)
   {
-    const Float a (1.0f / (1.0f - normal.z));
-    const Float b (normal.x * normal.y * a);
+    const T a (1.0f / (1.0f - normal.z));
+    const T b (normal.x * normal.y * a);
     *tangent  =
-        Normalize (Vec3 (1.0f - normal.x * normal.x * a, -b, normal.x));
+        Normalize (Vec3T <T> (1.0f - normal.x * normal.x * a, -b, normal.x));
     *binormal =
-        Normalize (Vec3 (b, normal.y * normal.y * a - 1.0f, -normal.y));
+        Normalize (Vec3T <T> (b, normal.y * normal.y * a - 1.0f, -normal.y));
   }
   else
   {
-    const Float a = 1.0f / (1.0f + normal.z);
-    const Float b = -normal.x * normal.y * a;
-    *tangent  = Vec3 (1.0f - normal.x * normal.x * a, b, -normal.x);
-    *binormal = Vec3 (b, 1.0f - normal.y * normal.y * a, -normal.y);
+    const T a = 1.0f / (1.0f + normal.z);
+    const T b = -normal.x * normal.y * a;
+    *tangent  = Vec3T <T> (1.0f - normal.x * normal.x * a, b, -normal.x);
+    *binormal = Vec3T <T> (b, 1.0f - normal.y * normal.y * a, -normal.y);
   }
-  *tangent  = *tangent  + Vec3 (0, 0, 0);
-  *binormal = *binormal + Vec3 (0, 0, 0);
+  *tangent  = *tangent  + Vec3T <T> (0, 0, 0);
+  *binormal = *binormal + Vec3T <T> (0, 0, 0);
 }
 /*
 // ---------------------------------------------------------------------------
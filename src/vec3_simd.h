@@ -0,0 +1,288 @@
+#ifndef _VEC3_SIMD_H_
+#define _VEC3_SIMD_H_
+/*
+// ---------------------------------------------------------------------------
+*/
+#include "core.h"
+#include "vec3.h"
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined (__AVX__)
+#include <immintrin.h>
+#endif
+/*
+// ---------------------------------------------------------------------------
+*/
+namespace
+{
+/*
+// ---------------------------------------------------------------------------
+// Three component vector padded to four lanes, the compute type of the hot
+// loops. Values are loaded from and stored to the packed Vec3T, the fourth
+// lane is kept at zero so that it never shows up in a dot product.
+//
+// The generic version is plain scalar code. float maps to one SSE register,
+// double to one AVX register, or to two SSE2 registers without AVX.
+// ---------------------------------------------------------------------------
+*/
+template <typename T>
+class Vec3A
+{
+  /* Vec3A constructors */
+public:
+  Vec3A () = default;
+  Vec3A (T x, T y, T z) : v_ {x, y, z, 0} {}
+  template <typename U>
+  explicit Vec3A (const Vec3T <U>& v) :
+    v_ {static_cast <T> (v.x), static_cast <T> (v.y), static_cast <T> (v.z), 0}
+  {}
+
+
+  /* Vec3A public methods */
+public:
+  auto Store () const -> Vec3T <T>
+  {
+    return Vec3T <T> (v_[0], v_[1], v_[2]);
+  }
+
+  auto operator + (const Vec3A& a) const -> Vec3A
+  {
+    return Vec3A (v_[0] + a.v_[0], v_[1] + a.v_[1], v_[2] + a.v_[2]);
+  }
+
+  auto operator - (const Vec3A& a) const -> Vec3A
+  {
+    return Vec3A (v_[0] - a.v_[0], v_[1] - a.v_[1], v_[2] - a.v_[2]);
+  }
+
+  auto operator * (T t) const -> Vec3A
+  {
+    return Vec3A (v_[0] * t, v_[1] * t, v_[2] * t);
+  }
+
+  auto Dot (const Vec3A& a) const -> T
+  {
+    return v_[0] * a.v_[0] + v_[1] * a.v_[1] + v_[2] * a.v_[2];
+  }
+
+
+  /* Vec3A private data */
+private:
+  alignas (4 * sizeof (T)) T v_[4];
+}; // class Vec3A
+/*
+// ---------------------------------------------------------------------------
+*/
+#if defined (__SSE2__)
+template <>
+class Vec3A <float>
+{
+  /* Vec3A constructors */
+public:
+  Vec3A () = default;
+  Vec3A (float x, float y, float z) : v_ (_mm_set_ps (0.0f, z, y, x)) {}
+  template <typename U>
+  explicit Vec3A (const Vec3T <U>& v) :
+    Vec3A (static_cast <float> (v.x),
+           static_cast <float> (v.y),
+           static_cast <float> (v.z))
+  {}
+
+
+  /* Vec3A public methods */
+public:
+  auto Store () const -> Vec3T <float>
+  {
+    alignas (16) float f[4];
+    _mm_store_ps (f, v_);
+    return Vec3T <float> (f[0], f[1], f[2]);
+  }
+
+  auto operator + (const Vec3A& a) const -> Vec3A
+  {
+    return Vec3A (_mm_add_ps (v_, a.v_));
+  }
+
+  auto operator - (const Vec3A& a) const -> Vec3A
+  {
+    return Vec3A (_mm_sub_ps (v_, a.v_));
+  }
+
+  auto operator * (float t) const -> Vec3A
+  {
+    return Vec3A (_mm_mul_ps (v_, _mm_set1_ps (t)));
+  }
+
+  auto Dot (const Vec3A& a) const -> float
+  {
+    // Horizontal sum without SSE3
+    const __m128 m (_mm_mul_ps (v_, a.v_));
+    const __m128 s (_mm_add_ps (m, _mm_movehl_ps (m, m)));
+    return _mm_cvtss_f32 (_mm_add_ss (s, _mm_shuffle_ps (s, s, 1)));
+  }
+
+
+  /* Vec3A private methods */
+private:
+  explicit Vec3A (__m128 v) : v_ (v) {}
+
+
+  /* Vec3A private data */
+private:
+  __m128 v_;
+}; // class Vec3A <float>
+#endif // __SSE2__
+/*
+// ---------------------------------------------------------------------------
+*/
+#if defined (__AVX__)
+template <>
+class Vec3A <double>
+{
+  /* Vec3A constructors */
+public:
+  Vec3A () = default;
+  Vec3A (double x, double y, double z) : v_ (_mm256_set_pd (0.0, z, y, x)) {}
+  template <typename U>
+  explicit Vec3A (const Vec3T <U>& v) :
+    Vec3A (static_cast <double> (v.x),
+           static_cast <double> (v.y),
+           static_cast <double> (v.z))
+  {}
+
+
+  /* Vec3A public methods */
+public:
+  auto Store () const -> Vec3T <double>
+  {
+    alignas (32) double d[4];
+    _mm256_store_pd (d, v_);
+    return Vec3T <double> (d[0], d[1], d[2]);
+  }
+
+  auto operator + (const Vec3A& a) const -> Vec3A
+  {
+    return Vec3A (_mm256_add_pd (v_, a.v_));
+  }
+
+  auto operator - (const Vec3A& a) const -> Vec3A
+  {
+    return Vec3A (_mm256_sub_pd (v_, a.v_));
+  }
+
+  auto operator * (double t) const -> Vec3A
+  {
+    return Vec3A (_mm256_mul_pd (v_, _mm256_set1_pd (t)));
+  }
+
+  auto Dot (const Vec3A& a) const -> double
+  {
+    const __m256d m  (_mm256_mul_pd (v_, a.v_));
+    const __m128d lo (_mm256_castpd256_pd128 (m));
+    const __m128d hi (_mm256_extractf128_pd (m, 1));
+    const __m128d s  (_mm_add_pd (lo, hi));
+    return _mm_cvtsd_f64 (_mm_add_sd (s, _mm_unpackhi_pd (s, s)));
+  }
+
+
+  /* Vec3A private methods */
+private:
+  explicit Vec3A (__m256d v) : v_ (v) {}
+
+
+  /* Vec3A private data */
+private:
+  __m256d v_;
+}; // class Vec3A <double>
+#elif defined (__SSE2__)
+template <>
+class Vec3A <double>
+{
+  /* Vec3A constructors */
+public:
+  Vec3A () = default;
+  Vec3A (double x, double y, double z) :
+    xy_ (_mm_set_pd (y, x)),
+    z_  (_mm_set_pd (0.0, z))
+  {}
+  template <typename U>
+  explicit Vec3A (const Vec3T <U>& v) :
+    Vec3A (static_cast <double> (v.x),
+           static_cast <double> (v.y),
+           static_cast <double> (v.z))
+  {}
+
+
+  /* Vec3A public methods */
+public:
+  auto Store () const -> Vec3T <double>
+  {
+    alignas (16) double d[4];
+    _mm_store_pd (d,     xy_);
+    _mm_store_pd (d + 2, z_);
+    return Vec3T <double> (d[0], d[1], d[2]);
+  }
+
+  auto operator + (const Vec3A& a) const -> Vec3A
+  {
+    return Vec3A (_mm_add_pd (xy_, a.xy_), _mm_add_pd (z_, a.z_));
+  }
+
+  auto operator - (const Vec3A& a) const -> Vec3A
+  {
+    return Vec3A (_mm_sub_pd (xy_, a.xy_), _mm_sub_pd (z_, a.z_));
+  }
+
+  auto operator * (double t) const -> Vec3A
+  {
+    const __m128d s (_mm_set1_pd (t));
+    return Vec3A (_mm_mul_pd (xy_, s), _mm_mul_pd (z_, s));
+  }
+
+  auto Dot (const Vec3A& a) const -> double
+  {
+    const __m128d s (_mm_add_pd (_mm_mul_pd (xy_, a.xy_),
+                                 _mm_mul_pd (z_,  a.z_)));
+    return _mm_cvtsd_f64 (_mm_add_sd (s, _mm_unpackhi_pd (s, s)));
+  }
+
+
+  /* Vec3A private methods */
+private:
+  Vec3A (__m128d xy, __m128d z) : xy_ (xy), z_ (z) {}
+
+
+  /* Vec3A private data */
+private:
+  __m128d xy_;
+  __m128d z_;
+}; // class Vec3A <double>
+#endif // __AVX__
+/*
+// ---------------------------------------------------------------------------
+*/
+template <typename T>
+auto Dot (const Vec3A <T>& v0, const Vec3A <T>& v1) -> T
+{
+  return v0.Dot (v1);
+}
+/*
+// ---------------------------------------------------------------------------
+*/
+static_assert (sizeof (Vec3A <float>)  == 4 * sizeof (float),
+               "Vec3A <float> must fill one 128 bit lane");
+static_assert (sizeof (Vec3A <double>) == 4 * sizeof (double),
+               "Vec3A <double> must fill one 256 bit lane");
+static_assert (std::is_trivially_copyable <Vec3A <float>>::value,
+               "Vec3A <float> must be trivially copyable");
+static_assert (std::is_trivially_copyable <Vec3A <double>>::value,
+               "Vec3A <double> must be trivially copyable");
+/*
+// ---------------------------------------------------------------------------
+*/
+}  // namespace
+/*
+// ---------------------------------------------------------------------------
+*/
+#endif // _VEC3_SIMD_H_